@@ -0,0 +1,33 @@
+// The application prepends the version and defines MAX_STRIDE, the grid of
+// the pixels started first, and PALETTE_WIDTH, the entries in a row of the
+// palette
+
+#define WAITING 2
+
+uniform highp isampler2D periods;
+uniform lowp sampler2D palette;
+uniform highp vec2 iScale;
+uniform highp vec2 iOffset;
+uniform int iStep;
+uniform highp ivec2 iGrid;
+
+out lowp vec4 frag_color;
+
+void main() {
+	highp ivec2 size = textureSize(periods, 0);
+	highp vec2 uv = gl_FragCoord.xy * iScale + iOffset;
+	highp ivec2 pos = clamp(ivec2(floor(uv * vec2(size))), ivec2(0), size - 1);
+	highp ivec4 s = texelFetch(periods, pos, 0);
+
+	// Show the pixels the refinement has not reached like the coarser
+	// ones they lie in
+	for (int stride = 2; s.w == WAITING && stride <= MAX_STRIDE; stride *= 2) {
+		highp ivec2 parent = (pos + iGrid) / stride * stride - iGrid;
+		s = texelFetch(periods, max(parent, ivec2(0)), 0);
+	}
+
+	// The index of the last iteration done, as with a single pass, in the
+	// palette built by the application with iStep iterations per entry
+	highp int i = max(s.z - 1, 0) / iStep;
+	frag_color = texelFetch(palette, ivec2(i % PALETTE_WIDTH, i / PALETTE_WIDTH), 0);
+}
@@ -0,0 +1,202 @@
+// Accuracy and speed of the FFT on orbits of the integer circle
+//
+// Usage: fft_bench [speed|accuracy]
+//
+// Both modes print CSV to the standard output. The speed mode times
+// fft_transform, the float and double plans and the batched plan on
+// powers of 2, primes, smooth composites and lengths of sampled orbits,
+// in both directions. The accuracy mode compares the spectra of long
+// orbits with a DFT evaluated in long double.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include <time.h>
+
+#define RFFT_IMPLEMENTATION
+#include "sokol/rfft.h"
+#define INTEGER_CIRCLE_IMPLEMENTATION
+#include "integer_circle.h"
+
+#define MAX_LEN (1 << 20)
+#define MAX_ITERS 16384 // longest orbit the explorer computes
+#define NUM_ORBITS 16
+#define NUM_BINS 16
+#define BATCH 64
+#define WORK 5000000.0 // butterflies per timed measurement
+
+static float orbit_x[MAX_LEN];
+static float orbit_y[MAX_LEN];
+static float complex input[MAX_LEN];
+static float complex output[MAX_LEN];
+static float complex output_orig[MAX_LEN];
+static double complex output_double[MAX_LEN];
+static float complex batch[BATCH * MAX_ITERS];
+
+static const size_t POWERS[] = { 16, 64, 256, 1024, 4096, 16384 };
+static const size_t PRIMES[] = { 17, 127, 1021, 4093, 16381 };
+static const size_t SMOOTH[] = { 60, 360, 1000, 2160, 6000, 15000 };
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/// Pick the parameters the way the keyboard does in the explorer
+static void random_params(float* delta, float* epsilon) {
+	const float octave = ldexp(1.0, rand() % 5 - 2);
+	const float period = 6.0 * octave / NOTES[rand() % 10];
+	*delta = (float) (rand() % 12 + 1) / (float) (rand() % 16 + 4) + 0.5;
+	*epsilon = other_parameter(period, *delta);
+}
+
+/// Sample a closed orbit starting roughly at the given distance from the origin
+static size_t random_orbit(float dist, size_t max_len, float* radius) {
+	for (;;) {
+		float delta, epsilon;
+		random_params(&delta, &epsilon);
+		const float a = 2 * M_PI * rand() / (float) RAND_MAX;
+		const point_t p = { floor(dist * cos(a)), floor(dist * sin(a)) };
+		const size_t n = ic_orbit(p, delta, epsilon, orbit_x, orbit_y,
+					 max_len, radius);
+		if (n < max_len) return n;
+	}
+}
+
+/// Fill the input with the orbit scaled into the unit circle
+static void orbit_input(size_t n, float radius) {
+	for (size_t i = 0; i < n; i++) {
+		input[i] = (orbit_x[i] + I*orbit_y[i]) / radius;
+	}
+}
+
+/// One bin of the DFT evaluated directly in long double
+static long double complex reference_bin(size_t n, size_t k) {
+	long double complex sum = 0;
+	for (size_t j = 0; j < n; j++) {
+		const long double angle = -2 * M_PI * (long double) ((j * k) % n) / n;
+		sum += (long double complex) input[j] * (cosl(angle) + I * sinl(angle));
+	}
+	return sum;
+}
+
+/// Time the body over enough repetitions of size n transforms
+#define TIME(n, body) ({ \
+	const size_t reps = 1 + WORK / ((n) * log2((n) + 1.0)); \
+	const double start = now(); \
+	for (size_t r = 0; r < reps; r++) { body; } \
+	(now() - start) / reps; \
+})
+
+static void print_speed(const char* set, size_t n, bool inverse,
+			const char* method, size_t count, double t, double t_orig) {
+	printf("%s,%zu,%s,%s,%zu,%.3f,%.2f\n", set, n, inverse ? "inverse" : "forward",
+	       method, count, 1e6 * t, t_orig / t);
+}
+
+/// Time all the methods on a signal of size n already stored in input
+static void bench_speed(const char* set, size_t n) {
+	for (int inverse = 0; inverse < 2; inverse++) {
+		fft_plan* plan = fft_plan_create(n, inverse);
+		fft_plan_double* plan_double = fft_plan_double_create(n, inverse);
+		const double t_orig = TIME(n, {
+			memcpy(output, input, n * sizeof(*output));
+			fft_transform(output, n, inverse);
+		});
+		const double t_plan = TIME(n, {
+			memcpy(output, input, n * sizeof(*output));
+			fft_plan_execute(plan, output);
+		});
+		const double t_double = TIME(n, {
+			for (size_t i = 0; i < n; i++) output_double[i] = input[i];
+			fft_plan_double_execute(plan_double, output_double);
+		});
+		const double t_batch = TIME(BATCH * n, {
+			for (size_t b = 0; b < BATCH; b++) {
+				memcpy(batch + b * n, input, n * sizeof(*batch));
+			}
+			fft_plan_execute_batch(plan, batch, BATCH);
+		}) / BATCH;
+
+		print_speed(set, n, inverse, "transform", 1, t_orig, t_orig);
+		print_speed(set, n, inverse, "plan", 1, t_plan, t_orig);
+		print_speed(set, n, inverse, "plan_double", 1, t_double, t_orig);
+		print_speed(set, n, inverse, "batch", BATCH, t_batch, t_orig);
+		fft_plan_destroy(plan);
+		fft_plan_double_destroy(plan_double);
+	}
+}
+
+static void bench_set(const char* set, const size_t* sizes, size_t count) {
+	for (size_t s = 0; s < count; s++) {
+		const size_t n = sizes[s];
+		for (size_t i = 0; i < n; i++) {
+			input[i] = rand() / (float) RAND_MAX + I * rand() / (float) RAND_MAX;
+		}
+		bench_speed(set, n);
+	}
+}
+
+static void speed() {
+	printf("set,n,direction,method,batch,us_per_signal,speedup\n");
+	bench_set("power", POWERS, sizeof(POWERS) / sizeof(*POWERS));
+	bench_set("prime", PRIMES, sizeof(PRIMES) / sizeof(*PRIMES));
+	bench_set("smooth", SMOOTH, sizeof(SMOOTH) / sizeof(*SMOOTH));
+
+	// Orbits from clicks on the explorer screen at the default zoom
+	for (size_t o = 0; o < NUM_ORBITS; o++) {
+		float radius;
+		const float dist = pow(10.0, 3.0 * rand() / (float) RAND_MAX);
+		const size_t n = random_orbit(dist, MAX_ITERS, &radius);
+		orbit_input(n, radius);
+		bench_speed("orbit", n);
+	}
+}
+
+static void accuracy() {
+	printf("n,radius,err_transform,err_plan,err_plan_double\n");
+	for (size_t o = 0; o < NUM_ORBITS; o++) {
+		float radius;
+		const float dist = pow(10.0, 1.0 + 4.0 * o / NUM_ORBITS);
+		const size_t n = random_orbit(dist, MAX_LEN, &radius);
+		orbit_input(n, radius);
+
+		fft_plan* plan = fft_plan_create(n, false);
+		fft_plan_double* plan_double = fft_plan_double_create(n, false);
+		for (size_t i = 0; i < n; i++) {
+			output_orig[i] = output[i] = output_double[i] = input[i];
+		}
+		fft_transform(output_orig, n, false);
+		fft_plan_execute(plan, output);
+		fft_plan_double_execute(plan_double, output_double);
+
+		// Largest error of the normalized spectrum
+		double err[3] = { 0, 0, 0 };
+		for (size_t b = 0; b < NUM_BINS; b++) {
+			const size_t k = rand() % n;
+			const long double complex ref = reference_bin(n, k);
+			err[0] = fmax(err[0], cabsl(output_orig[k] - ref) / n);
+			err[1] = fmax(err[1], cabsl(output[k] - ref) / n);
+			err[2] = fmax(err[2], cabsl(output_double[k] - ref) / n);
+		}
+
+		printf("%zu,%.0f,%.3e,%.3e,%.3e\n", n, radius, err[0], err[1], err[2]);
+		fft_plan_destroy(plan);
+		fft_plan_double_destroy(plan_double);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	srand(1);
+	if (argc < 2 || !strcmp(argv[1], "speed")) {
+		speed();
+	} else if (!strcmp(argv[1], "accuracy")) {
+		accuracy();
+	} else {
+		fprintf(stderr, "Usage: %s [speed|accuracy]\n", argv[0]);
+		return 1;
+	}
+	return 0;
+}
@@ -1,6 +1,11 @@
-#version 100
+// The application prepends the version and defines VIEW, the view to
+// render, SLICE, the iterations added to every pixel per frame, and
+// MAX_STRIDE, the grid of the pixels started first
 
-#define ITERS 512
+// Status of the orbit of a pixel
+#define RUNNING 0
+#define CLOSED 1
+#define WAITING 2 // not started by the refinement yet
 
 uniform mediump vec2 iRes;
 uniform mediump vec2 iCam;
@@ -8,59 +13,59 @@ uniform mediump float iZoom;
 uniform mediump float iDelta;
 uniform mediump float iEpsilon;
 uniform mediump vec2 iPoint;
-uniform int iView;
-uniform int iColor;
+uniform int iStart;
+uniform int iIters;
+uniform int iStride;
+uniform highp ivec2 iRows;
+uniform highp ivec2 iGrid;
 
-mediump vec3 fractal(mediump vec2 z, mediump float delta, mediump float epsilon) {
-	if (iView == 1 && z == iPoint) {
-		return vec3(1.0, 0.0, 0.0);
+// The state after the previous slice
+uniform highp isampler2D state;
+
+// The current point of the orbit, the number of iterations done and the status
+out highp ivec4 next;
+
+/// Whether the pixel starts in this pass of the refinement: it lies in the
+/// rows of the pass and on the grid of the stride, which moves with the view
+bool due(highp ivec2 pos) {
+	return pos.y >= iRows.x && pos.y < iRows.y && (pos + iGrid) % iStride == ivec2(0);
+}
+
+highp ivec4 fractal(mediump vec2 start, mediump float delta, mediump float epsilon) {
+	highp ivec2 pos = ivec2(gl_FragCoord.xy);
+	highp ivec4 s;
+	if (iStart == 1) {
+		s = ivec4(0, 0, 0, WAITING);
+	} else {
+		s = texelFetch(state, pos, 0);
+	}
+	if (s.w == WAITING && due(pos)) {
+		s = ivec4(ivec2(start), 0, RUNNING);
 	}
 
-	mediump vec2 pz = z;
-	int i;
-	for (int j = 0; j < ITERS; ++j) {
-		i = j;
+	mediump vec2 z = vec2(s.xy);
+	highp int n = s.z;
+	int status = s.w;
+	highp int end = min(n + SLICE, iIters);
+	while (status == RUNNING && n < end) {
 		z.x -= floor(delta * z.y);
 		z.y += floor(epsilon * z.x);
 		z.x -= floor(delta * z.y);
-		if (z == pz) { break; }
-		if (iView == 1 && z == iPoint) {
-			return vec3(1.0, 0.0, 0.0);
+		n++;
+		if (z == start) {
+			status = CLOSED;
 		}
 	}
-
-    if (iColor == 1) {
-        // Colors in the YCoCg space
-	    lowp float y = (1.0 - float(i)/float(ITERS));
-	    y = pow(y, 1.5);
-	    lowp float co = sin(float(i) * 0.1) * min(y, 1.0-y)/sqrt(2.0);
-	    lowp float cg = cos(float(i) * 0.1) * min(y, 1.0-y)/sqrt(2.0);
-
-	    lowp float tmp = y - cg;
-	    return vec3(tmp + co, y + cg, tmp - co);
-    } else {
-        lowp float r = sin(float(i) * 0.1) * 0.5 + 0.5;
-	    lowp float g = cos(float(i) * 0.1) * 0.5 + 0.5;
-	    lowp float l = log(float(i))/log(float(ITERS));
-	    lowp float b = 1.0 - 2.0*l + 2.0*l*l;
-
-	    lowp float scale = 1.0 - float(i)/float(ITERS);
-	    return scale*vec3(r, g, b);
-    }
+	return ivec4(ivec2(z), n, status);
 }
 
 void main() {
 	mediump vec2 screen_pos = gl_FragCoord.xy - (iRes.xy * 0.5);
 
 	mediump vec2 c = vec2((screen_pos * vec2(1.0, -1.0)) / iZoom - iCam);
-	lowp vec3 col;
-	if (iView == 1) {
-		mediump float a = 2.0*iEpsilon/sqrt(iDelta*iEpsilon*(4.0 - iDelta*iEpsilon));
-		mediump float b = sqrt(iDelta*iEpsilon/(4.0 - iDelta*iEpsilon));
-		col = fractal(floor(c), iDelta, iEpsilon);
+	if (VIEW == 1) {
+		next = fractal(floor(c), iDelta, iEpsilon);
 	} else {
-		col = fractal(iPoint, c.x, c.y);
+		next = fractal(iPoint, c.x, c.y);
 	}
-
-	gl_FragColor = vec4(clamp(col, 0.0, 1.0), 1.0);
 }
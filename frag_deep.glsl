@@ -0,0 +1,92 @@
+// The application prepends the version and defines SLICE, the iterations
+// added to every pixel per frame, and MAX_STRIDE, the grid of the pixels
+// started first.
+//
+// The d/e plane zoomed in beyond the precision of floats. The parameters
+// are pairs of floats, whose sum has about twice the precision of one.
+
+// Status of the orbit of a pixel
+#define RUNNING 0
+#define CLOSED 1
+#define WAITING 2 // not started by the refinement yet
+
+uniform highp vec2 iRes;
+uniform highp vec2 iCam;
+uniform highp vec2 iCamLo;
+uniform highp float iZoom;
+uniform highp vec2 iPoint;
+uniform int iStart;
+uniform int iIters;
+uniform int iStride;
+uniform highp ivec2 iRows;
+uniform highp ivec2 iGrid;
+
+// The state after the previous slice
+uniform highp isampler2D state;
+
+// The current point of the orbit, the number of iterations done and the status
+out highp ivec4 next;
+
+/// A float split into two halves of 12 bits, whose products with other
+/// halves are exact. Masking the bits keeps the compiler from simplifying
+/// the split away, like it may do with the arithmetic of the usual one.
+highp vec2 split(highp float a) {
+	highp float hi = uintBitsToFloat(floatBitsToUint(a) & 0xFFFFF000u);
+	return vec2(hi, a - hi);
+}
+
+/// floor(d * y) for the pair d, whose first float is split into dh, and
+/// an integer y below 2^24 in magnitude. The product of the first float
+/// is rounded to p with the error err, the second float only adds a bit.
+highp float floor_mul(highp vec2 d, highp vec2 dh, highp float y) {
+	highp float yh = floor(y * (1.0 / 4096.0)) * 4096.0;
+	highp float yl = y - yh;
+	highp float p = d.x * y;
+	highp float err = ((dh.x * yh - p) + dh.x * yl + dh.y * yh) + dh.y * yl;
+	highp float f = floor(p);
+	return f + floor((p - f) + (err + d.y * y));
+}
+
+/// Whether the pixel starts in this pass of the refinement: it lies in the
+/// rows of the pass and on the grid of the stride, which moves with the view
+bool due(highp ivec2 pos) {
+	return pos.y >= iRows.x && pos.y < iRows.y && (pos + iGrid) % iStride == ivec2(0);
+}
+
+highp ivec4 fractal(highp vec2 delta, highp vec2 epsilon) {
+	highp ivec2 pos = ivec2(gl_FragCoord.xy);
+	highp ivec4 s;
+	if (iStart == 1) {
+		s = ivec4(0, 0, 0, WAITING);
+	} else {
+		s = texelFetch(state, pos, 0);
+	}
+	if (s.w == WAITING && due(pos)) {
+		s = ivec4(ivec2(iPoint), 0, RUNNING);
+	}
+
+	highp vec2 dh = split(delta.x);
+	highp vec2 eh = split(epsilon.x);
+	highp vec2 z = vec2(s.xy);
+	highp int n = s.z;
+	int status = s.w;
+	highp int end = min(n + SLICE, iIters);
+	while (status == RUNNING && n < end) {
+		z.x -= floor_mul(delta, dh, z.y);
+		z.y += floor_mul(epsilon, eh, z.x);
+		z.x -= floor_mul(delta, dh, z.y);
+		n++;
+		if (z == iPoint) {
+			status = CLOSED;
+		}
+	}
+	return ivec4(ivec2(z), n, status);
+}
+
+void main() {
+	// The offset from the center of the screen is small, so it joins the
+	// low part of the camera
+	highp vec2 offset = (gl_FragCoord.xy - iRes * 0.5) * vec2(1.0, -1.0) / iZoom;
+	highp vec2 lo = offset - iCamLo;
+	next = fractal(vec2(-iCam.x, lo.x), vec2(-iCam.y, lo.y));
+}
@@ -0,0 +1,104 @@
+// The application prepends the version and defines VIEW, the view to
+// render, SLICE, the iterations added to every pixel per frame, and
+// MAX_STRIDE, the grid of the pixels started first
+
+// Status of the orbit of a pixel
+#define RUNNING 0
+#define CLOSED 1
+#define WAITING 2 // not started by the refinement yet
+
+// Fractional bits of the fixed-point parameters
+#define FRAC_BITS 24
+
+uniform highp vec2 iRes;
+uniform highp vec2 iCam;
+uniform highp vec2 iCamLo;
+uniform highp float iZoom;
+uniform highp float iDelta;
+uniform highp float iEpsilon;
+uniform highp vec2 iPoint;
+uniform int iStart;
+uniform int iIters;
+uniform int iStride;
+uniform highp ivec2 iRows;
+uniform highp ivec2 iGrid;
+
+// The state after the previous slice
+uniform highp isampler2D state;
+
+// The current point of the orbit, the number of iterations done and the status
+out highp ivec4 next;
+
+/// floor(a * b / 2^FRAC_BITS) from the full 64-bit product, which GLSL ES 3.0
+/// lacks, assembled from 16-bit limbs
+highp int mul_fixed(highp int a, highp int b) {
+	highp uint ua = uint(a), ub = uint(b);
+	highp uint a0 = ua & 0xFFFFu, a1 = ua >> 16;
+	highp uint b0 = ub & 0xFFFFu, b1 = ub >> 16;
+
+	highp uint mid = a1 * b0;
+	highp uint mid2 = a0 * b1;
+	highp uint hi = a1 * b1 + (mid >> 16) + (mid2 >> 16);
+	highp uint lo = a0 * b0;
+	highp uint carry = (mid & 0xFFFFu) + (mid2 & 0xFFFFu) + (lo >> 16);
+	lo = (lo & 0xFFFFu) | (carry << 16);
+	hi += carry >> 16;
+
+	// Correct the unsigned product for negative factors
+	if (a < 0) hi -= ub;
+	if (b < 0) hi -= ua;
+	return int((lo >> FRAC_BITS) | (hi << (32 - FRAC_BITS)));
+}
+
+/// Whether the pixel starts in this pass of the refinement: it lies in the
+/// rows of the pass and on the grid of the stride, which moves with the view
+bool due(highp ivec2 pos) {
+	return pos.y >= iRows.x && pos.y < iRows.y && (pos + iGrid) % iStride == ivec2(0);
+}
+
+highp ivec4 fractal(highp ivec2 start, highp float delta, highp float epsilon) {
+	highp ivec2 pos = ivec2(gl_FragCoord.xy);
+	highp ivec4 s;
+	if (iStart == 1) {
+		s = ivec4(0, 0, 0, WAITING);
+	} else {
+		s = texelFetch(state, pos, 0);
+	}
+	if (s.w == WAITING && due(pos)) {
+		s = ivec4(start, 0, RUNNING);
+	}
+
+	const highp float one = float(1 << FRAC_BITS);
+	highp int d = int(round(delta * one));
+	highp int e = int(round(epsilon * one));
+	highp ivec2 z = s.xy;
+	highp int n = s.z;
+	int status = s.w;
+	highp int end = min(n + SLICE, iIters);
+	while (status == RUNNING && n < end) {
+		z.x -= mul_fixed(d, z.y);
+		z.y += mul_fixed(e, z.x);
+		z.x -= mul_fixed(d, z.y);
+		n++;
+		if (z == start) {
+			status = CLOSED;
+		}
+	}
+	return ivec4(z, n, status);
+}
+
+void main() {
+	highp vec2 screen_pos = gl_FragCoord.xy - (iRes.xy * 0.5);
+
+	highp vec2 offset = (screen_pos * vec2(1.0, -1.0)) / iZoom;
+	if (VIEW == 1) {
+		// The cell of the camera adds in integers, which keep the cells
+		// exact out to 2^31, where floats lose them from 2^24 on
+		highp vec2 cell = floor(-iCam);
+		highp vec2 within = offset + ((-iCam - cell) - iCamLo);
+		next = fractal(ivec2(cell) + ivec2(floor(within)), iDelta, iEpsilon);
+	} else {
+		highp vec2 c = offset - iCam;
+		next = fractal(ivec2(iPoint), c.x, c.y);
+	}
+}
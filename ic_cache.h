@@ -0,0 +1,305 @@
+#ifndef IC_CACHE_H
+#define IC_CACHE_H
+// Tiles of finished period maps kept for reuse, under a cap on their memory.
+// The explorer keeps the tiles of both views in one cache and so does
+// ic_render for the frames of videos. The least recently used tiles go first.
+// An atlas is a file of tiles rendered ahead of time, which the explorer maps
+// into memory to show them as soon as it needs them.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "integer_circle.h"
+
+/// Side of the tiles in pixels
+#define IC_CACHE_TILE 64
+
+/// A tile of the pixel grid of a zoom. The pixel (x, y) of the grid has its
+/// center at ((x + 0.5)/zoom, (y + 0.5)/zoom) in the plane of the view, whose
+/// y axis points down the screen, and the tile holds the pixels from
+/// (x, y)*IC_CACHE_TILE on. The inputs a view does not depend on are zero.
+typedef struct {
+	uint32_t view; // 1 for the x/y plane, 0 for the d/e plane
+	uint32_t kernel; // that rendered the tile, numbered by the user of the cache
+	float delta; // parameters of the x/y plane
+	float epsilon;
+	point_t p; // starting point of the d/e plane
+	uint32_t iters; // iteration cap
+	float zoom; // pixels per unit
+	int64_t x;
+	int64_t y;
+} ic_tile_key_t;
+
+typedef struct ic_cached ic_cached_t;
+
+typedef struct {
+	ic_cached_t** buckets; // chains of the tiles by the hash of their keys
+	size_t num_buckets;
+	ic_cached_t* newest; // ends of the list of the tiles by their last use
+	ic_cached_t* oldest;
+	size_t count;
+	size_t max_count;
+	size_t hits;
+	size_t misses;
+	size_t evicted;
+} ic_cache_t;
+
+/// A cache of tiles taking up to max_bytes, or NULL if not a tile fits
+ic_cache_t* ic_cache_create(size_t max_bytes);
+
+void ic_cache_destroy(ic_cache_t* cache);
+
+/// The periods of the tile, IC_CACHE_TILE rows of IC_CACHE_TILE from the top
+/// left, with 0 for the orbits that did not close within the cap, or NULL
+/// if the tile is not in the cache. The tile becomes the most recently used.
+const uint32_t* ic_cache_get(ic_cache_t* cache, const ic_tile_key_t* key);
+
+/// The storage of the periods of the tile for the caller to fill in,
+/// dropping the least recently used tiles to make room for it
+uint32_t* ic_cache_put(ic_cache_t* cache, const ic_tile_key_t* key);
+
+/// The pixel of the grid of the zoom at the top left of an image of w x h
+/// pixels centered on (cx, cy), if the pixels of the image lie on the grid
+/// within a thousandth of a pixel
+bool ic_grid_origin(double cx, double cy, double zoom, int w, int h,
+		    int64_t* x, int64_t* y);
+
+/// Magic bytes at the start of atlases, with the version of the format
+#define IC_ATLAS_MAGIC "ICATLAS1"
+
+/// The header of an atlas file, followed by the keys of its tiles in the
+/// order of ic_compare_keys and by their periods in the same order
+typedef struct {
+	char magic[8];
+	uint32_t tile; // IC_CACHE_TILE
+	uint32_t key_size; // of ic_tile_key_t
+	uint64_t count; // of tiles
+} ic_atlas_header_t;
+
+/// An atlas mapped into memory
+typedef struct {
+	void* map;
+	size_t size;
+	size_t count;
+	const ic_tile_key_t* keys;
+	const uint32_t* periods;
+} ic_atlas_t;
+
+/// The order of the keys in atlases, for qsort
+int ic_compare_keys(const void* a, const void* b);
+
+/// Map the atlas file into memory, or return NULL if it is not one
+ic_atlas_t* ic_atlas_open(const char* path);
+
+void ic_atlas_close(ic_atlas_t* atlas);
+
+/// The periods of the tile like ic_cache_get, or NULL if it is not in the atlas
+const uint32_t* ic_atlas_get(const ic_atlas_t* atlas, const ic_tile_key_t* key);
+
+#endif // IC_CACHE_H
+
+#ifdef IC_CACHE_IMPLEMENTATION
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct ic_cached {
+	ic_tile_key_t key;
+	ic_cached_t* next_in_bucket;
+	ic_cached_t* newer;
+	ic_cached_t* older;
+	uint32_t periods[IC_CACHE_TILE * IC_CACHE_TILE];
+};
+
+/// FNV-1a over the fields of the key, which may have padding between them
+static uint64_t ic_hash_bytes(uint64_t h, const void* data, size_t len) {
+	const uint8_t* bytes = data;
+	for (size_t i = 0; i < len; i++) {
+		h = (h ^ bytes[i]) * 0x100000001b3ull;
+	}
+	return h;
+}
+
+static uint64_t ic_hash_key(const ic_tile_key_t* k) {
+	uint64_t h = 0xcbf29ce484222325ull;
+	h = ic_hash_bytes(h, &k->view, sizeof(k->view));
+	h = ic_hash_bytes(h, &k->kernel, sizeof(k->kernel));
+	h = ic_hash_bytes(h, &k->delta, sizeof(k->delta));
+	h = ic_hash_bytes(h, &k->epsilon, sizeof(k->epsilon));
+	h = ic_hash_bytes(h, &k->p, sizeof(k->p));
+	h = ic_hash_bytes(h, &k->iters, sizeof(k->iters));
+	h = ic_hash_bytes(h, &k->zoom, sizeof(k->zoom));
+	h = ic_hash_bytes(h, &k->x, sizeof(k->x));
+	return ic_hash_bytes(h, &k->y, sizeof(k->y));
+}
+
+static bool ic_same_key(const ic_tile_key_t* a, const ic_tile_key_t* b) {
+	return a->view == b->view && a->kernel == b->kernel && a->delta == b->delta
+		&& a->epsilon == b->epsilon && a->p.x == b->p.x && a->p.y == b->p.y
+		&& a->iters == b->iters && a->zoom == b->zoom && a->x == b->x && a->y == b->y;
+}
+
+ic_cache_t* ic_cache_create(size_t max_bytes) {
+	const size_t max_count = max_bytes / sizeof(ic_cached_t);
+	if (max_count == 0) return NULL;
+	ic_cache_t* cache = calloc(1, sizeof(ic_cache_t));
+	cache->max_count = max_count;
+	cache->num_buckets = 1;
+	while (cache->num_buckets < max_count) {
+		cache->num_buckets *= 2;
+	}
+	cache->buckets = calloc(cache->num_buckets, sizeof(ic_cached_t*));
+	return cache;
+}
+
+void ic_cache_destroy(ic_cache_t* cache) {
+	if (!cache) return;
+	for (ic_cached_t* c = cache->newest; c; ) {
+		ic_cached_t* older = c->older;
+		free(c);
+		c = older;
+	}
+	free(cache->buckets);
+	free(cache);
+}
+
+static void ic_unlink(ic_cache_t* cache, ic_cached_t* c) {
+	if (c->newer) c->newer->older = c->older;
+	else cache->newest = c->older;
+	if (c->older) c->older->newer = c->newer;
+	else cache->oldest = c->newer;
+}
+
+static void ic_push_newest(ic_cache_t* cache, ic_cached_t* c) {
+	c->newer = NULL;
+	c->older = cache->newest;
+	if (cache->newest) cache->newest->newer = c;
+	else cache->oldest = c;
+	cache->newest = c;
+}
+
+/// The tile of the key and the link in its bucket that points to it, which
+/// is the end of the chain if it is not there
+static ic_cached_t** ic_find(ic_cache_t* cache, const ic_tile_key_t* key) {
+	ic_cached_t** link = &cache->buckets[ic_hash_key(key) & (cache->num_buckets - 1)];
+	while (*link && !ic_same_key(&(*link)->key, key)) {
+		link = &(*link)->next_in_bucket;
+	}
+	return link;
+}
+
+const uint32_t* ic_cache_get(ic_cache_t* cache, const ic_tile_key_t* key) {
+	ic_cached_t* c = *ic_find(cache, key);
+	if (!c) {
+		cache->misses++;
+		return NULL;
+	}
+	cache->hits++;
+	ic_unlink(cache, c);
+	ic_push_newest(cache, c);
+	return c->periods;
+}
+
+uint32_t* ic_cache_put(ic_cache_t* cache, const ic_tile_key_t* key) {
+	ic_cached_t** link = ic_find(cache, key);
+	ic_cached_t* c = *link;
+	if (c) {
+		ic_unlink(cache, c);
+		ic_push_newest(cache, c);
+		return c->periods;
+	}
+	if (cache->count == cache->max_count) {
+		// Reuse the storage of the oldest tile
+		c = cache->oldest;
+		ic_unlink(cache, c);
+		ic_cached_t** old = ic_find(cache, &c->key);
+		*old = c->next_in_bucket;
+		cache->evicted++;
+		// The chain may have been the one of the new key
+		link = ic_find(cache, key);
+	} else {
+		c = malloc(sizeof(ic_cached_t));
+		cache->count++;
+	}
+	c->key = *key;
+	c->next_in_bucket = NULL;
+	*link = c;
+	ic_push_newest(cache, c);
+	return c->periods;
+}
+
+/// -1 or 1 as a is less than or greater than b, nothing if they are equal
+#define IC_ORDER(a, b) if ((a) != (b)) return (a) < (b) ? -1 : 1
+
+int ic_compare_keys(const void* a, const void* b) {
+	const ic_tile_key_t* k = a;
+	const ic_tile_key_t* l = b;
+	IC_ORDER(k->view, l->view);
+	IC_ORDER(k->kernel, l->kernel);
+	IC_ORDER(k->delta, l->delta);
+	IC_ORDER(k->epsilon, l->epsilon);
+	IC_ORDER(k->p.x, l->p.x);
+	IC_ORDER(k->p.y, l->p.y);
+	IC_ORDER(k->iters, l->iters);
+	IC_ORDER(k->zoom, l->zoom);
+	IC_ORDER(k->y, l->y);
+	IC_ORDER(k->x, l->x);
+	return 0;
+}
+
+ic_atlas_t* ic_atlas_open(const char* path) {
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+	struct stat st;
+	void* map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(ic_atlas_header_t)) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) return NULL;
+
+	const size_t size = st.st_size;
+	const ic_atlas_header_t* header = map;
+	const size_t entry = sizeof(ic_tile_key_t)
+		+ IC_CACHE_TILE * IC_CACHE_TILE * sizeof(uint32_t);
+	if (memcmp(header->magic, IC_ATLAS_MAGIC, sizeof(header->magic))
+	    || header->tile != IC_CACHE_TILE || header->key_size != sizeof(ic_tile_key_t)
+	    || header->count != (size - sizeof(*header)) / entry
+	    || sizeof(*header) + header->count * entry != size) {
+		munmap(map, size);
+		return NULL;
+	}
+	ic_atlas_t* atlas = malloc(sizeof(ic_atlas_t));
+	atlas->map = map;
+	atlas->size = size;
+	atlas->count = header->count;
+	atlas->keys = (const ic_tile_key_t*) (header + 1);
+	atlas->periods = (const uint32_t*) (atlas->keys + atlas->count);
+	return atlas;
+}
+
+void ic_atlas_close(ic_atlas_t* atlas) {
+	if (!atlas) return;
+	munmap(atlas->map, atlas->size);
+	free(atlas);
+}
+
+const uint32_t* ic_atlas_get(const ic_atlas_t* atlas, const ic_tile_key_t* key) {
+	const ic_tile_key_t* found = bsearch(key, atlas->keys, atlas->count,
+					     sizeof(ic_tile_key_t), ic_compare_keys);
+	if (!found) return NULL;
+	return atlas->periods + (found - atlas->keys) * IC_CACHE_TILE * IC_CACHE_TILE;
+}
+
+bool ic_grid_origin(double cx, double cy, double zoom, int w, int h,
+		    int64_t* x, int64_t* y) {
+	const double ox = cx * zoom - 0.5 * w, oy = cy * zoom - 0.5 * h;
+	*x = llround(ox);
+	*y = llround(oy);
+	return fabs(ox - *x) < 1e-3 && fabs(oy - *y) < 1e-3;
+}
+
+#endif // IC_CACHE_IMPLEMENTATION
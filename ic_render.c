@@ -0,0 +1,1063 @@
+// Period maps of the integer circle rendered on the CPU
+//
+// Usage: ic_render census [options]
+//        ic_render image [options] > image.ppm
+//        ic_render compare FILE [options]
+//        ic_render poster FILE [options]
+//        ic_render video SCRIPT VIDEO.y4m AUDIO.wav [options]
+//        ic_render atlas FILE [options]
+//
+// The census mode prints the number of pixels of every period as CSV, with
+// the period 0 for the orbits that do not close, and reports the work done
+// to the standard error. The image mode writes the pixels colored like the
+// explorer colors them as a PPM image, whose comment holds the options that
+// render it. The compare mode renders the image of FILE with these options,
+// followed by the given ones, and reports the pixels that differ from it.
+// The P key of the explorer saves what its GPU rendered in such a file.
+// The poster mode writes the same image into FILE a tile at a time, for
+// sizes that do not fit in memory. If it gets interrupted, running it again
+// with the same options resumes it from FILE.progress.
+//
+// The video mode renders the path of SCRIPT into a Y4M video and the sound
+// of the orbit of the starting point along it, synthesized like the
+// explorer plays it, into a WAV file. Every line of SCRIPT is a keyframe
+// of a time in seconds followed by the options that change there, the
+// ones before it and the given ones hold otherwise:
+//
+//   0 -v 0 -p 3,2 -c 1,1 -z 200
+//   10 -c 1.2,1.3 -z 20000
+//   12 -p 5,1
+//
+// Between keyframes the parameters and the center move linearly and the
+// zoom geometrically, the other options change at the keyframe. The center
+// stays on the pixel grid of the zoom, so the frames that revisit a region
+// at the same zoom, or pan over it, reuse the tiles rendered before.
+//
+// The atlas mode renders the region of the d/e plane for the starting
+// points of every -p into FILE, which the explorer maps into memory to show
+// the tiles it finds there at once instead of computing them. The region is
+// the image the options give, at its zoom and at the levels of zooming out
+// by the scroll wheel after it, those the explorer reaches from the zoom.
+// The zooms deeper than floats resolve are left to the explorer.
+//
+// The options select the region like the explorer:
+//
+//   -v VIEW         1 for the x/y plane (default), 0 for the d/e plane
+//   -d DELTA        parameters of the x/y plane
+//   -e EPSILON
+//   -p X,Y          starting point of the d/e plane, atlases take several
+//   -c X,Y          center of the region
+//   -z ZOOM         pixels per unit, 1 or 5000 by default
+//   -s WxH          size in pixels, 640x480 by default
+//   -n ITERS        iteration cap, 16384 by default
+//   -k KERNEL       float computes in floats (default), fixed like the
+//                   integer kernel of the explorer, and deep with the
+//                   parameters of the d/e plane in double precision
+//   -m METHOD       naive computes every pixel (default), trace fills the
+//                   regions with borders of a single period, and interval
+//                   fills the blocks of the d/e plane whose orbits provably
+//                   agree, which pays off when zoomed in so deep that the
+//                   blocks are large.
+//   -t THREADS      threads rendering the tiles, all processors by default
+//   -f FPS          frames per second of videos, 30 by default
+//   -l LEVELS       zoom levels of atlases, 1 by default
+//   --cache MB      memory for the tiles the frames of videos reuse, 256 by
+//                   default, 0 to render every frame from scratch
+//   --color N       color scheme, the loaded palettes follow the built-in ones
+//   --palette FILE  load a palette like the explorer does
+//   --check         compare the census with the naive renderer
+//
+// Like in the explorer, zooms into the d/e plane deeper than floats resolve
+// take the deep kernel unless another one is given. Atlases take the fixed
+// kernel that the explorer runs on OpenGL by default, -k float makes them
+// for the explorers without it. The fixed kernel falls back to floats, as
+// in the explorer, for parameters of 128 or more, beyond its fixed point.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define INTEGER_CIRCLE_IMPLEMENTATION
+#include "integer_circle.h"
+#define IC_RENDER_IMPLEMENTATION
+#include "ic_render.h"
+#define IC_CACHE_IMPLEMENTATION
+#include "ic_cache.h"
+
+#define MAX_ITERS 16384 // longest orbit the explorer computes
+#define MAX_PALETTES 16
+#define MAX_THREADS 256
+#define TILE IC_CACHE_TILE // side of the tiles the threads take and the cache keeps
+#define POSTER_TILE 256 // side of the tiles of posters, written out as they finish
+#define HEADER_SIZE 4096 // longest PPM header
+#define MAX_KEYFRAMES 4096
+#define MAX_POINTS 64 // starting points of an atlas
+#define WHEEL_ZOOM 1.1 // zoom of a step of the scroll wheel of the explorer
+
+/// Names of the methods, by ic_method_t
+static const char* METHODS[] = { "naive", "trace", "interval" };
+
+/// Names of the kernels, by ic_kernel_t
+static const char* KERNELS[] = { "float", "fixed", "deep" };
+
+typedef struct {
+	ic_view_t view;
+	double cx, cy; // center of the region
+	double zoom;
+	int kernel; // given by -k, or -1
+	ic_method_t method;
+	int threads;
+	int fps; // frames per second of videos
+	int levels; // of zoom in atlases
+	point_t points[MAX_POINTS]; // every -p, for atlases
+	size_t num_points;
+	uint32_t color;
+	const char* palette_files[MAX_PALETTES];
+	ic_palette_t palettes[MAX_PALETTES];
+	size_t num_palettes;
+	bool check;
+	size_t cache_mb; // of the tiles videos reuse
+	ic_cache_t* cache; // of the frames of videos, NULL otherwise
+} options_t;
+
+/// The tiles of an image, taken by the threads in turn. With a cache, the
+/// tiles lie on the grid of the zoom if the image does.
+typedef struct {
+	const options_t* opt;
+	ic_method_t method;
+	uint32_t* periods;
+	atomic_int next;
+	ic_cache_t* cache;
+	pthread_mutex_t lock; // of the cache
+	int64_t origin[2]; // pixel of the grid at the top left of the image
+} job_t;
+
+/// A poster rendered in tiles straight into its image file. The progress
+/// file has a copy of the header and a byte per tile, set once the tile is
+/// written, so an interrupted job resumes where it stopped.
+typedef struct {
+	const options_t* opt;
+	int fd;
+	int progress_fd;
+	uint8_t* done; // tiles written before resuming
+	size_t header; // length of the header of both files
+	int cols, rows;
+	atomic_int next;
+	atomic_int finished;
+} poster_t;
+
+/// The tiles of an atlas, rendered by the threads in turn into its file
+typedef struct {
+	const options_t* opt;
+	const ic_tile_key_t* keys;
+	size_t count;
+	int fd;
+	atomic_size_t next;
+} atlas_t;
+
+/// The options a video script sets at a time
+typedef struct {
+	double time;
+	ic_view_t view;
+	double cx, cy;
+	double zoom;
+	int kernel;
+} keyframe_t;
+
+typedef struct {
+	void* job;
+	pthread_t thread;
+	ic_stats_t stats;
+} worker_t;
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "Usage: %s census|image|compare FILE|poster FILE|video SCRIPT VIDEO AUDIO\n"
+		"       |atlas FILE [-v VIEW] [-d DELTA] [-e EPSILON] [-p X,Y] [-c X,Y] [-z ZOOM]\n"
+		"       [-s WxH] [-n ITERS] [-k float|fixed|deep] [-m naive|trace|interval]\n"
+		"       [-t THREADS] [-f FPS] [-l LEVELS] [--color N] [--palette FILE] [--cache MB]\n"
+		"       [--check]\n",
+		name);
+	exit(1);
+}
+
+/// The index of val in the names, or -1
+static int find_name(const char* val, const char** names, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		if (!strcmp(val, names[i])) return i;
+	}
+	return -1;
+}
+
+/// Parse the options among the arguments into opt, false if one is invalid
+static bool parse_args(options_t* opt, int argc, char* argv[]) {
+	for (int i = 0; i < argc; i++) {
+		const char* arg = argv[i];
+		if (!strcmp(arg, "--check")) {
+			opt->check = true;
+			continue;
+		}
+		if (i + 1 == argc) return false;
+		const char* val = argv[++i];
+		if (!strcmp(arg, "--color")) {
+			opt->color = atoi(val);
+			continue;
+		}
+		if (!strcmp(arg, "--cache")) {
+			opt->cache_mb = atol(val);
+			continue;
+		}
+		if (!strcmp(arg, "--palette")) {
+			if (opt->num_palettes == MAX_PALETTES) return false;
+			if (!ic_load_palette(val, &opt->palettes[opt->num_palettes])) {
+				fprintf(stderr, "%s: cannot load the palette\n", val);
+				return false;
+			}
+			opt->palette_files[opt->num_palettes++] = val;
+			continue;
+		}
+		if (arg[0] != '-' || strlen(arg) != 2) return false;
+		bool ok = true;
+		int k;
+		switch (arg[1]) {
+			case 'v': opt->view.view = atoi(val) != 0; break;
+			case 'd': opt->view.delta = atof(val); break;
+			case 'e': opt->view.epsilon = atof(val); break;
+			case 'p':
+				ok = sscanf(val, "%f,%f", &opt->view.p.x, &opt->view.p.y) == 2;
+				if (ok && opt->num_points < MAX_POINTS) {
+					opt->points[opt->num_points++] = opt->view.p;
+				}
+				break;
+			case 'c': ok = sscanf(val, "%lf,%lf", &opt->cx, &opt->cy) == 2; break;
+			case 'z': opt->zoom = atof(val); break;
+			case 's':
+				ok = sscanf(val, "%dx%d", &opt->view.width, &opt->view.height) == 2
+					&& opt->view.width > 0 && opt->view.height > 0;
+				break;
+			case 'n': opt->view.max_iters = atol(val); break;
+			case 'k':
+				k = find_name(val, KERNELS, sizeof(KERNELS) / sizeof(*KERNELS));
+				opt->kernel = k;
+				ok = k >= 0;
+				break;
+			case 'm':
+				k = find_name(val, METHODS, sizeof(METHODS) / sizeof(*METHODS));
+				opt->method = k;
+				ok = k >= 0;
+				break;
+			case 't': opt->threads = atoi(val); break;
+			case 'f': opt->fps = atoi(val); break;
+			case 'l': opt->levels = atoi(val); break;
+			default: ok = false; break;
+		}
+		if (!ok) return false;
+	}
+	return true;
+}
+
+static options_t default_options() {
+	return (options_t){
+		.view = {
+			.view = 1,
+			.delta = 0.5,
+			.epsilon = 1.381966,
+			.p = { 0, 0 },
+			.width = 640,
+			.height = 480,
+			.max_iters = MAX_ITERS,
+		},
+		.kernel = -1,
+		.method = IC_NAIVE,
+		.fps = 30,
+		.levels = 1,
+		.cache_mb = 256,
+	};
+}
+
+/// Place the camera of the view like the explorer does and pick the kernel
+static void place_camera(options_t* opt) {
+	ic_view_t* v = &opt->view;
+	if (opt->zoom <= 0) {
+		opt->zoom = v->view ? 1.0 : 5000.0;
+	}
+	v->zoom = opt->zoom;
+	v->cam = (point_t){ -opt->cx, -opt->cy };
+	v->cam_lo = (point_t){ -opt->cx - v->cam.x, -opt->cy - v->cam.y };
+	const double magnitude = fmax(fabs(opt->cx), fabs(opt->cy))
+		+ 0.5 * fmax(v->width, v->height) / opt->zoom;
+	if (opt->kernel < 0) {
+		v->kernel = !v->view && ic_deep_zoom(magnitude, opt->zoom) ? IC_DEEP : IC_FLOAT;
+	} else {
+		v->kernel = opt->kernel;
+	}
+	// The parameters beyond the fixed point take floats, like in the explorer
+	const bool fits = v->view
+		? ic_fits_fixed(fmax(fabs(v->delta), fabs(v->epsilon)), magnitude)
+		: ic_fits_fixed(magnitude, fmax(fabs(v->p.x), fabs(v->p.y)));
+	if (v->kernel == IC_FIXED && !fits) {
+		v->kernel = IC_FLOAT;
+	}
+}
+
+/// Place the camera, check the options and count the threads
+static void finish_options(options_t* opt, const char* name) {
+	ic_view_t* v = &opt->view;
+	place_camera(opt);
+	if (v->kernel == IC_DEEP && v->view) usage(name);
+	if (opt->fps <= 0) usage(name);
+	if (opt->color >= IC_SCHEMES + opt->num_palettes) usage(name);
+	if (opt->threads <= 0) {
+		opt->threads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (opt->threads < 1) opt->threads = 1;
+	if (opt->threads > MAX_THREADS) opt->threads = MAX_THREADS;
+}
+
+/// Copy the rows of a tile between images whose rows are the given strides apart
+static void copy_tile(uint32_t* dst, size_t dst_stride, const uint32_t* src,
+		      size_t src_stride) {
+	for (int j = 0; j < TILE; j++) {
+		memcpy(dst + j * dst_stride, src + j * src_stride, TILE * sizeof(uint32_t));
+	}
+}
+
+static void* work(void* arg) {
+	worker_t* worker = arg;
+	job_t* job = worker->job;
+	const ic_view_t* v = &job->opt->view;
+	// The first tiles start before the image to lie on the grid
+	const int x0 = -(int) (job->origin[0] & (TILE - 1));
+	const int y0 = -(int) (job->origin[1] & (TILE - 1));
+	const int cols = (v->width - x0 + TILE - 1) / TILE;
+	const int rows = (v->height - y0 + TILE - 1) / TILE;
+	ic_tile_key_t key = {
+		.view = v->view,
+		.kernel = v->kernel,
+		.delta = v->view ? v->delta : 0,
+		.epsilon = v->view ? v->epsilon : 0,
+		.p = v->view ? (point_t){ 0, 0 } : v->p,
+		.iters = v->max_iters,
+		.zoom = v->zoom,
+	};
+	for (int t; (t = atomic_fetch_add(&job->next, 1)) < cols * rows; ) {
+		int x = x0 + t % cols * TILE, y = y0 + t / cols * TILE, w = TILE, h = TILE;
+		if (x < 0) { w += x; x = 0; }
+		if (y < 0) { h += y; y = 0; }
+		if (v->width - x < w) w = v->width - x;
+		if (v->height - y < h) h = v->height - y;
+		uint32_t* out = job->periods + (size_t) y * v->width + x;
+
+		// Only the tiles within the image are kept
+		const bool cached = job->cache && w == TILE && h == TILE;
+		if (cached) {
+			key.x = (job->origin[0] + x) / TILE;
+			key.y = (job->origin[1] + y) / TILE;
+			pthread_mutex_lock(&job->lock);
+			const uint32_t* tile = ic_cache_get(job->cache, &key);
+			if (tile) copy_tile(out, v->width, tile, TILE);
+			pthread_mutex_unlock(&job->lock);
+			if (tile) {
+				worker->stats.filled += TILE * TILE;
+				continue;
+			}
+		}
+		ic_render_tile(v, job->method, out, v->width, x, y, w, h, &worker->stats);
+		if (cached) {
+			pthread_mutex_lock(&job->lock);
+			copy_tile(ic_cache_put(job->cache, &key), TILE, out, v->width);
+			pthread_mutex_unlock(&job->lock);
+		}
+	}
+	return NULL;
+}
+
+/// Run work on the job on the threads, this one included, and add up the
+/// work they did to stats
+static void run_workers(void* (*work)(void*), void* job, int threads, ic_stats_t* stats) {
+	worker_t workers[MAX_THREADS] = { 0 };
+	for (int i = 0; i < threads; i++) {
+		workers[i].job = job;
+		if (i > 0) pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+	}
+	work(&workers[0]);
+	for (int i = 0; i < threads; i++) {
+		if (i > 0) pthread_join(workers[i].thread, NULL);
+		stats->iterated += workers[i].stats.iterated;
+		stats->filled += workers[i].stats.filled;
+		stats->blocks += workers[i].stats.blocks;
+		stats->iterations += workers[i].stats.iterations;
+	}
+}
+
+/// Render the periods of the view in tiles on all the threads
+static uint32_t* render(const options_t* opt, ic_method_t method, ic_stats_t* stats) {
+	const size_t w = opt->view.width, h = opt->view.height;
+	job_t job = { .opt = opt, .method = method, .periods = malloc(w * h * sizeof(uint32_t)) };
+	const ic_view_t* v = &opt->view;
+	const double cx = -(double) v->cam.x - v->cam_lo.x, cy = -(double) v->cam.y - v->cam_lo.y;
+	if (opt->cache && ic_grid_origin(cx, cy, v->zoom, v->width, v->height,
+					 &job.origin[0], &job.origin[1])) {
+		job.cache = opt->cache;
+		pthread_mutex_init(&job.lock, NULL);
+	}
+	run_workers(work, &job, opt->threads, stats);
+	if (job.cache) pthread_mutex_destroy(&job.lock);
+	return job.periods;
+}
+
+static void print_stats(const char* name, const ic_stats_t* stats, double t) {
+	const size_t total = stats->iterated + stats->filled;
+	fprintf(stderr, "%s: iterated %zu of %zu points (%.1f%%), %zu blocks, "
+		"%llu steps, %.3f s\n", name, stats->iterated, total,
+		total ? 100.0 * stats->iterated / total : 0.0, stats->blocks,
+		(unsigned long long) stats->iterations, t);
+}
+
+/// Render the view and report the work done
+static uint32_t* render_timed(const options_t* opt, ic_method_t method) {
+	ic_stats_t stats = { 0 };
+	const double start = now();
+	uint32_t* periods = render(opt, method, &stats);
+	print_stats(METHODS[method], &stats, now() - start);
+	return periods;
+}
+
+static int census(const options_t* opt) {
+	const size_t n = (size_t) opt->view.width * opt->view.height;
+	uint32_t* periods = render_timed(opt, opt->method);
+
+	size_t* counts = calloc(opt->view.max_iters + 1, sizeof(*counts));
+	for (size_t i = 0; i < n; i++) {
+		counts[periods[i]]++;
+	}
+	printf("period,count\n");
+	for (size_t p = 0; p <= opt->view.max_iters; p++) {
+		if (counts[p]) printf("%zu,%zu\n", p, counts[p]);
+	}
+
+	int status = 0;
+	if (opt->check) {
+		uint32_t* ref = render_timed(opt, IC_NAIVE);
+		size_t wrong = 0;
+		for (size_t i = 0; i < n; i++) {
+			wrong += periods[i] != ref[i];
+		}
+		fprintf(stderr, "check: %zu of %zu points differ\n", wrong, n);
+		status = wrong != 0;
+		free(ref);
+	}
+	free(counts);
+	free(periods);
+	return status;
+}
+
+/// Color n periods like the explorer does, 3 bytes per pixel
+static void color_periods(const options_t* opt, const uint32_t* periods, size_t n,
+			  uint8_t* rgb) {
+	const uint32_t iters = opt->view.max_iters;
+	for (size_t i = 0; i < n; i++) {
+		const uint32_t count = periods[i] == IC_OPEN ? iters : periods[i];
+		ic_count_color(opt->color, opt->palettes, count, iters, rgb + 3 * i);
+	}
+}
+
+/// Render the view in the colors of the explorer
+static uint8_t* render_image(const options_t* opt) {
+	const size_t n = (size_t) opt->view.width * opt->view.height;
+	uint32_t* periods = render_timed(opt, opt->method);
+	uint8_t* rgb = malloc(3 * n);
+	color_periods(opt, periods, n, rgb);
+	free(periods);
+	return rgb;
+}
+
+/// Format the PPM header of the image with the options in its comment into
+/// buf and return its length, or exit if it does not fit
+static size_t format_header(const options_t* opt, char* buf, size_t len) {
+	const ic_view_t* v = &opt->view;
+	const double cx = -(double) v->cam.x - v->cam_lo.x;
+	const double cy = -(double) v->cam.y - v->cam_lo.y;
+	size_t n = snprintf(buf, len, "P6\n# ic_render image -v %u -d %.9g -e %.9g -p %.9g,%.9g "
+			    "-c %.17g,%.17g -z %.9g -s %dx%d -n %zu -k %s", v->view, v->delta,
+			    v->epsilon, v->p.x, v->p.y, cx, cy, v->zoom, v->width, v->height,
+			    v->max_iters, KERNELS[v->kernel]);
+	for (size_t i = 0; i < opt->num_palettes && n < len; i++) {
+		n += snprintf(buf + n, len - n, " --palette %s", opt->palette_files[i]);
+	}
+	if (n < len) {
+		n += snprintf(buf + n, len - n, " --color %u\n%d %d\n255\n", opt->color,
+			      v->width, v->height);
+	}
+	if (n >= len) {
+		fprintf(stderr, "The options do not fit in the header of the image\n");
+		exit(1);
+	}
+	return n;
+}
+
+static int image(const options_t* opt) {
+	char header[HEADER_SIZE];
+	fwrite(header, 1, format_header(opt, header, sizeof(header)), stdout);
+	uint8_t* rgb = render_image(opt);
+	fwrite(rgb, 3, (size_t) opt->view.width * opt->view.height, stdout);
+	free(rgb);
+	return 0;
+}
+
+static void write_at(int fd, const void* buf, size_t len, off_t offset) {
+	if (pwrite(fd, buf, len, offset) != (ssize_t) len) {
+		perror("pwrite");
+		exit(1);
+	}
+}
+
+static void* poster_work(void* arg) {
+	worker_t* worker = arg;
+	poster_t* p = worker->job;
+	const options_t* opt = p->opt;
+	const ic_view_t* v = &opt->view;
+	uint32_t* periods = malloc(POSTER_TILE * POSTER_TILE * sizeof(*periods));
+	uint8_t* rgb = malloc(3 * POSTER_TILE * POSTER_TILE);
+	const int tiles = p->cols * p->rows;
+	for (int t; (t = atomic_fetch_add(&p->next, 1)) < tiles; ) {
+		if (p->done[t]) continue;
+		const int x = t % p->cols * POSTER_TILE, y = t / p->cols * POSTER_TILE;
+		const int w = v->width - x < POSTER_TILE ? v->width - x : POSTER_TILE;
+		const int h = v->height - y < POSTER_TILE ? v->height - y : POSTER_TILE;
+		ic_render_tile(v, opt->method, periods, w, x, y, w, h, &worker->stats);
+		color_periods(opt, periods, (size_t) w * h, rgb);
+		for (int j = 0; j < h; j++) {
+			const off_t offset = p->header + 3 * ((off_t) (y + j) * v->width + x);
+			write_at(p->fd, rgb + 3 * j * w, 3 * w, offset);
+		}
+		// Only marked done after its pixels
+		const uint8_t done = 1;
+		write_at(p->progress_fd, &done, 1, p->header + t);
+		const int finished = atomic_fetch_add(&p->finished, 1) + 1;
+		if (100 * finished / tiles != 100 * (finished - 1) / tiles) {
+			fprintf(stderr, "\rposter: %d%% of %d tiles", 100 * finished / tiles, tiles);
+		}
+	}
+	free(rgb);
+	free(periods);
+	return NULL;
+}
+
+static int poster(const char* path, const options_t* opt) {
+	const ic_view_t* v = &opt->view;
+	char header[HEADER_SIZE], old[HEADER_SIZE];
+	poster_t p = {
+		.opt = opt,
+		.header = format_header(opt, header, sizeof(header)),
+		.cols = (v->width + POSTER_TILE - 1) / POSTER_TILE,
+		.rows = (v->height + POSTER_TILE - 1) / POSTER_TILE,
+	};
+	const int tiles = p.cols * p.rows;
+	const off_t size = p.header + 3 * (off_t) v->width * v->height;
+	char progress[HEADER_SIZE];
+	snprintf(progress, sizeof(progress), "%s.progress", path);
+	p.fd = open(path, O_RDWR | O_CREAT, 0644);
+	p.progress_fd = open(progress, O_RDWR | O_CREAT, 0644);
+	if (p.fd < 0 || p.progress_fd < 0) {
+		perror(p.fd < 0 ? path : progress);
+		return 1;
+	}
+
+	// Resume if the progress is of a poster with the same options, in
+	// an image of the right size
+	p.done = calloc(tiles, 1);
+	struct stat st;
+	bool resume = !fstat(p.fd, &st) && st.st_size == size
+		&& pread(p.progress_fd, old, p.header, 0) == (ssize_t) p.header
+		&& !memcmp(old, header, p.header)
+		&& pread(p.progress_fd, p.done, tiles, p.header) == tiles;
+	if (!resume) {
+		memset(p.done, 0, tiles);
+		if (ftruncate(p.progress_fd, 0) || ftruncate(p.progress_fd, p.header + tiles)
+		    || ftruncate(p.fd, 0) || ftruncate(p.fd, size)) {
+			perror(path);
+			return 1;
+		}
+		write_at(p.progress_fd, header, p.header, 0);
+		write_at(p.fd, header, p.header, 0);
+	}
+	int done = 0;
+	for (int t = 0; t < tiles; t++) {
+		done += p.done[t];
+	}
+	atomic_init(&p.finished, done);
+	if (done) {
+		fprintf(stderr, "poster: resuming with %d of %d tiles done\n", done, tiles);
+	}
+
+	ic_stats_t stats = { 0 };
+	const double start = now();
+	run_workers(poster_work, &p, opt->threads, &stats);
+	fprintf(stderr, "\n");
+	print_stats(METHODS[opt->method], &stats, now() - start);
+	// The progress goes once the image is safely written
+	const bool ok = !fsync(p.fd);
+	if (ok) {
+		unlink(progress);
+	} else {
+		perror(path);
+	}
+	close(p.fd);
+	close(p.progress_fd);
+	free(p.done);
+	return !ok;
+}
+
+/// Read a binary PPM image and the options in its comment, which is kept
+/// in comment. Return the pixels, or NULL if the file is not such an image.
+static uint8_t* read_ppm(const char* path, int* width, int* height, char* comment,
+			 size_t len) {
+	FILE* f = fopen(path, "rb");
+	if (!f) return NULL;
+	uint8_t* rgb = NULL;
+	int fields[3], max;
+	char line[4096];
+	comment[0] = '\0';
+	if (!fgets(line, sizeof(line), f) || strncmp(line, "P6", 2)) goto done;
+	for (int i = 0; i < 3; ) {
+		if (!fgets(line, sizeof(line), f)) goto done;
+		if (line[0] == '#') {
+			if (!strncmp(line, "# ic_render image ", 18)) {
+				snprintf(comment, len, "%s", line + 18);
+			}
+			continue;
+		}
+		for (char* s = line; i < 3; i++) {
+			char* end;
+			fields[i] = strtol(s, &end, 10);
+			if (end == s) break;
+			s = end;
+		}
+	}
+	*width = fields[0];
+	*height = fields[1];
+	max = fields[2];
+	if (*width <= 0 || *height <= 0 || max != 255) goto done;
+	const size_t n = (size_t) *width * *height;
+	rgb = malloc(3 * n);
+	if (fread(rgb, 3, n, f) != n) {
+		free(rgb);
+		rgb = NULL;
+	}
+done:
+	fclose(f);
+	return rgb;
+}
+
+static int compare(const char* path, int argc, char* argv[]) {
+	int w, h;
+	char comment[4096];
+	uint8_t* expected = read_ppm(path, &w, &h, comment, sizeof(comment));
+	if (!expected) {
+		fprintf(stderr, "%s: not a binary PPM image\n", path);
+		return 1;
+	}
+	if (!comment[0]) {
+		fprintf(stderr, "%s: the image has no ic_render options\n", path);
+		return 1;
+	}
+
+	char* args[64];
+	int num_args = 0;
+	for (char* s = strtok(comment, " \n"); s && num_args < 64; s = strtok(NULL, " \n")) {
+		args[num_args++] = s;
+	}
+	options_t opt = default_options();
+	if (!parse_args(&opt, num_args, args) || !parse_args(&opt, argc, argv)) usage("ic_render");
+	finish_options(&opt, "ic_render");
+	if (opt.view.width != w || opt.view.height != h) {
+		fprintf(stderr, "%s: the image is %dx%d, the options render %dx%d\n", path,
+			w, h, opt.view.width, opt.view.height);
+		return 1;
+	}
+
+	uint8_t* rgb = render_image(&opt);
+	const size_t n = (size_t) w * h;
+	size_t wrong = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (memcmp(rgb + 3 * i, expected + 3 * i, 3)) {
+			if (wrong == 0) {
+				const uint8_t* a = expected + 3 * i;
+				const uint8_t* b = rgb + 3 * i;
+				fprintf(stderr, "compare: first at %zu,%zu: %d %d %d, rendered %d %d %d\n",
+					i % w, i / w, a[0], a[1], a[2], b[0], b[1], b[2]);
+			}
+			wrong++;
+		}
+	}
+	fprintf(stderr, "compare: %zu of %zu pixels differ\n", wrong, n);
+	free(rgb);
+	free(expected);
+	return wrong != 0;
+}
+
+/// Read the keyframes of a video script, each setting its options on top
+/// of the ones before. Return their number, or 0 if the script is invalid.
+static size_t read_script(const char* path, options_t* opt, keyframe_t* keys, size_t len) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "%s: cannot open the script\n", path);
+		return 0;
+	}
+	size_t n = 0;
+	char line[4096];
+	for (int num = 1; fgets(line, sizeof(line), f); num++) {
+		char* args[64];
+		int num_args = 0;
+		for (char* s = strtok(line, " \t\r\n"); s && num_args < 64;
+		     s = strtok(NULL, " \t\r\n")) {
+			args[num_args++] = s;
+		}
+		if (num_args == 0 || args[0][0] == '#') continue;
+
+		char* end;
+		const double time = strtod(args[0], &end);
+		bool ok = n < len && *end == '\0' && (n == 0 || time > keys[n - 1].time)
+			&& parse_args(opt, num_args - 1, args + 1);
+		if (ok && n == 0) {
+			place_camera(opt);
+		}
+		ok = ok && opt->zoom > 0 && !(opt->kernel == IC_DEEP && opt->view.view)
+			&& (n == 0 || (opt->view.width == keys[0].view.width
+				       && opt->view.height == keys[0].view.height));
+		if (!ok) {
+			fprintf(stderr, "%s:%d: invalid keyframe\n", path, num);
+			fclose(f);
+			return 0;
+		}
+		keys[n++] = (keyframe_t){ time, opt->view, opt->cx, opt->cy, opt->zoom, opt->kernel };
+	}
+	fclose(f);
+	if (n == 0) {
+		fprintf(stderr, "%s: no keyframes\n", path);
+	}
+	return n;
+}
+
+/// Set the options of the video at time t between the keyframes a and b
+static void interpolate(options_t* opt, const keyframe_t* a, const keyframe_t* b, double t) {
+	const double s = b == a ? 0.0 : (t - a->time) / (b->time - a->time);
+	opt->view = a->view;
+	opt->kernel = a->kernel;
+	opt->view.delta = a->view.delta + s * (b->view.delta - a->view.delta);
+	opt->view.epsilon = a->view.epsilon + s * (b->view.epsilon - a->view.epsilon);
+	opt->cx = a->cx + s * (b->cx - a->cx);
+	opt->cy = a->cy + s * (b->cy - a->cy);
+	opt->zoom = a->zoom * pow(b->zoom / a->zoom, s);
+	// Keep the center on the pixel grid of the zoom, less than a pixel
+	// away, so that the frames panning reuse the tiles of the ones before
+	const float zoom = opt->zoom;
+	const double w = 0.5 * opt->view.width, h = 0.5 * opt->view.height;
+	opt->cx = (round(opt->cx * zoom - w) + w) / zoom;
+	opt->cy = (round(opt->cy * zoom - h) + h) / zoom;
+	place_camera(opt);
+}
+
+/// Write the pixels as a frame of 4:4:4 Y4M video in BT.601 limited range
+static void write_frame(FILE* f, const uint8_t* rgb, size_t n, uint8_t* planes) {
+	for (size_t i = 0; i < n; i++) {
+		const int r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+		planes[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+		planes[n + i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+		planes[2 * n + i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+	}
+	fputs("FRAME\n", f);
+	fwrite(planes, 1, 3 * n, f);
+}
+
+static void put_le(uint8_t* buf, uint32_t val, int bytes) {
+	for (int i = 0; i < bytes; i++) {
+		buf[i] = val >> (8 * i);
+	}
+}
+
+/// Write the header of a WAV file of 16 bit stereo samples, of which there
+/// are n pairs
+static void write_wav_header(FILE* f, uint32_t n) {
+	uint8_t h[44];
+	const uint32_t size = 4 * n;
+	memcpy(h, "RIFF", 4);
+	put_le(h + 4, 36 + size, 4);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	put_le(h + 16, 16, 4);
+	put_le(h + 20, 1, 2); // PCM
+	put_le(h + 22, 2, 2); // channels
+	put_le(h + 24, IC_SAMPLE_RATE, 4);
+	put_le(h + 28, 4 * IC_SAMPLE_RATE, 4); // bytes per second
+	put_le(h + 32, 4, 2); // bytes per sample pair
+	put_le(h + 34, 16, 2); // bits per sample
+	memcpy(h + 36, "data", 4);
+	put_le(h + 40, size, 4);
+	fseek(f, 0, SEEK_SET);
+	fwrite(h, 1, sizeof(h), f);
+}
+
+/// Change the parameters the synth plays like the explorer does when they
+/// change on the screen: the playing point fades out and a new point
+/// replaces it, or it keeps going in the new orbit if only the parameters
+/// changed
+static void move_synth(ic_synth_t* synth, const ic_view_t* v, float* xs, float* ys) {
+	synth->old_p = synth->p;
+	synth->old_volume = synth->volume * synth->start_volume;
+	const point_t p = { floor(v->p.x), floor(v->p.y) };
+	if (p.x != synth->p.x || p.y != synth->p.y) {
+		synth->p = p;
+		synth->volume = 1.0;
+	}
+	ic_orbit(synth->p, v->delta, v->epsilon, xs, ys, MAX_ITERS, &synth->radius);
+	synth->start_volume = 0.4;
+}
+
+static int video(const char* script, const char* video_path, const char* audio_path,
+		 options_t* opt) {
+	keyframe_t* keys = malloc(MAX_KEYFRAMES * sizeof(*keys));
+	const size_t num_keys = read_script(script, opt, keys, MAX_KEYFRAMES);
+	if (num_keys == 0) return 1;
+	finish_options(opt, "ic_render");
+	FILE* vf = fopen(video_path, "wb");
+	FILE* af = fopen(audio_path, "wb");
+	if (!vf || !af) {
+		fprintf(stderr, "Cannot create the video or the audio file\n");
+		return 1;
+	}
+
+	const size_t w = keys[0].view.width, h = keys[0].view.height, n = w * h;
+	const double duration = keys[num_keys - 1].time - keys[0].time;
+	const size_t frames = (size_t) floor(duration * opt->fps) + 1;
+	fprintf(vf, "YUV4MPEG2 W%zu H%zu F%d:1 Ip A1:1 C444\n", w, h, opt->fps);
+	uint8_t* rgb = malloc(3 * n);
+	uint8_t* planes = malloc(3 * n);
+
+	// The audio of a frame lasts until the next one, stepping the orbit
+	// IC_MAX_FREQ times a second like the explorer
+	const size_t steps = IC_SAMPLE_RATE / IC_MAX_FREQ;
+	const size_t max_samples = IC_SAMPLE_RATE / opt->fps + steps + 1;
+	float* samples = malloc(2 * max_samples * sizeof(float));
+	int16_t* pcm = malloc(2 * max_samples * sizeof(int16_t));
+	float* xs = malloc(MAX_ITERS * sizeof(float));
+	float* ys = malloc(MAX_ITERS * sizeof(float));
+	ic_synth_t synth = { .volume = 1.0, .start_volume = 1.0, .old_volume = 0.0 };
+	size_t written = 0;
+	write_wav_header(af, 0);
+
+	opt->cache = ic_cache_create(opt->cache_mb << 20);
+	ic_stats_t stats = { 0 };
+	const double start = now();
+	ic_view_t last = { 0 };
+	size_t key = 0;
+	for (size_t frame = 0; frame < frames; frame++) {
+		const double t = keys[0].time + (double) frame / opt->fps;
+		while (key + 1 < num_keys && keys[key + 1].time <= t) key++;
+		interpolate(opt, &keys[key], &keys[key + 1 < num_keys ? key + 1 : key], t);
+
+		uint32_t* periods = render(opt, opt->method, &stats);
+		color_periods(opt, periods, n, rgb);
+		write_frame(vf, rgb, n, planes);
+		free(periods);
+
+		const ic_view_t* v = &opt->view;
+		if (frame == 0 || v->delta != last.delta || v->epsilon != last.epsilon
+		    || v->p.x != last.p.x || v->p.y != last.p.y) {
+			move_synth(&synth, v, xs, ys);
+			last = *v;
+		}
+		const size_t end = (frame + 1) * IC_SAMPLE_RATE / opt->fps;
+		const size_t len = steps * ((end - written) / steps);
+		ic_synthesize(&synth, v->delta, v->epsilon, steps, samples, len);
+		for (size_t i = 0; i < 2 * len; i++) {
+			pcm[i] = 32767 * fmaxf(-1.0, fminf(samples[i], 1.0));
+		}
+		fwrite(pcm, 4, len, af);
+		written += len;
+	}
+	write_wav_header(af, written);
+
+	const double t = now() - start;
+	print_stats(METHODS[opt->method], &stats, t);
+	fprintf(stderr, "video: %zu frames, %.2f s of video in %.2f s, %.1fx real time\n",
+		frames, (double) frames / opt->fps, t, frames / (opt->fps * t));
+	if (opt->cache) {
+		fprintf(stderr, "cache: %zu hits, %zu misses, %zu tiles dropped\n",
+			opt->cache->hits, opt->cache->misses, opt->cache->evicted);
+	}
+	ic_cache_destroy(opt->cache);
+	const bool ok = !ferror(vf) && !ferror(af);
+	fclose(vf);
+	fclose(af);
+	free(keys);
+	free(rgb);
+	free(planes);
+	free(samples);
+	free(pcm);
+	free(xs);
+	free(ys);
+	return !ok;
+}
+
+static void* atlas_work(void* arg) {
+	worker_t* worker = arg;
+	atlas_t* a = worker->job;
+	const size_t tile_size = TILE * TILE * sizeof(uint32_t);
+	const size_t start = sizeof(ic_atlas_header_t) + a->count * sizeof(ic_tile_key_t);
+	uint32_t periods[TILE * TILE];
+	for (size_t t; (t = atomic_fetch_add(&a->next, 1)) < a->count; ) {
+		// A view of the tile alone, centered on it
+		const ic_tile_key_t* key = &a->keys[t];
+		ic_view_t v = a->opt->view;
+		v.view = 0;
+		v.p = key->p;
+		v.kernel = key->kernel;
+		v.zoom = key->zoom;
+		v.width = v.height = TILE;
+		const double cx = (key->x + 0.5) * TILE / key->zoom;
+		const double cy = (key->y + 0.5) * TILE / key->zoom;
+		v.cam = (point_t){ -cx, -cy };
+		v.cam_lo = (point_t){ -cx - v.cam.x, -cy - v.cam.y };
+		ic_render_tile(&v, a->opt->method, periods, TILE, 0, 0, TILE, TILE, &worker->stats);
+		write_at(a->fd, periods, tile_size, start + t * tile_size);
+	}
+	return NULL;
+}
+
+static int atlas(const char* path, options_t* opt) {
+	if (opt->view.view || opt->levels < 1) usage("ic_render");
+	if (opt->num_points == 0) {
+		opt->points[opt->num_points++] = opt->view.p;
+	}
+	const ic_kernel_t kernel = opt->kernel < 0 ? IC_FIXED : opt->kernel;
+	const double w = 0.5 * opt->view.width / opt->zoom, h = 0.5 * opt->view.height / opt->zoom;
+	const double magnitude = fmax(fabs(opt->cx), fabs(opt->cy)) + fmax(w, h);
+
+	// The tiles covering the region at every level, zooming out like the
+	// explorer does, in floats
+	size_t count = 0, len = 1024;
+	ic_tile_key_t* keys = malloc(len * sizeof(*keys));
+	float zoom = opt->zoom;
+	for (int level = 0; level < opt->levels; level++, zoom *= pow(WHEEL_ZOOM, -1.0)) {
+		if (ic_deep_zoom(magnitude, zoom)) continue;
+		const int64_t x0 = floor(((opt->cx - w) * zoom - 0.5) / TILE);
+		const int64_t x1 = floor(((opt->cx + w) * zoom - 0.5) / TILE);
+		const int64_t y0 = floor(((opt->cy - h) * zoom - 0.5) / TILE);
+		const int64_t y1 = floor(((opt->cy + h) * zoom - 0.5) / TILE);
+		// What the explorer sees at the zoom, beyond the fixed point
+		// of the integer kernel it takes floats
+		const double reach = fmax(fabs(opt->cx), fabs(opt->cy))
+			+ 0.5 * fmax(opt->view.width, opt->view.height) / zoom;
+		for (size_t i = 0; i < opt->num_points; i++) {
+			const point_t p = opt->points[i];
+			const bool fits = ic_fits_fixed(reach, fmax(fabs(p.x), fabs(p.y)));
+			for (int64_t y = y0; y <= y1; y++) {
+				for (int64_t x = x0; x <= x1; x++) {
+					if (count == len) {
+						len *= 2;
+						keys = realloc(keys, len * sizeof(*keys));
+					}
+					keys[count++] = (ic_tile_key_t){
+						.view = 0,
+						.kernel = kernel == IC_FIXED && !fits ? IC_FLOAT : kernel,
+						.p = p,
+						.iters = opt->view.max_iters,
+						.zoom = zoom,
+						.x = x,
+						.y = y,
+					};
+				}
+			}
+		}
+	}
+	// In the order the explorer looks them up in, once each
+	qsort(keys, count, sizeof(*keys), ic_compare_keys);
+	size_t unique = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (unique == 0 || ic_compare_keys(&keys[unique - 1], &keys[i])) {
+			keys[unique++] = keys[i];
+		}
+	}
+	count = unique;
+
+	const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+	const size_t size = sizeof(ic_atlas_header_t)
+		+ count * (sizeof(ic_tile_key_t) + TILE * TILE * sizeof(uint32_t));
+	if (ftruncate(fd, size)) {
+		perror(path);
+		return 1;
+	}
+	write_at(fd, keys, count * sizeof(*keys), sizeof(ic_atlas_header_t));
+	atlas_t a = { .opt = opt, .keys = keys, .count = count, .fd = fd };
+	ic_stats_t stats = { 0 };
+	const double start = now();
+	run_workers(atlas_work, &a, opt->threads, &stats);
+	print_stats(METHODS[opt->method], &stats, now() - start);
+
+	// The header goes last, the explorer does not take the file before
+	ic_atlas_header_t header = { .tile = TILE, .key_size = sizeof(ic_tile_key_t),
+				     .count = count };
+	memcpy(header.magic, IC_ATLAS_MAGIC, sizeof(header.magic));
+	write_at(fd, &header, sizeof(header), 0);
+	close(fd);
+	fprintf(stderr, "atlas: %zu tiles of %zu points, %.1f MB\n", count, opt->num_points,
+		size / 1048576.0);
+	free(keys);
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) usage(argv[0]);
+	if (!strcmp(argv[1], "video")) {
+		if (argc < 5) usage(argv[0]);
+		options_t opt = default_options();
+		if (!parse_args(&opt, argc - 5, argv + 5)) usage(argv[0]);
+		return video(argv[2], argv[3], argv[4], &opt);
+	}
+	if (!strcmp(argv[1], "compare")) {
+		if (argc < 3) usage(argv[0]);
+		return compare(argv[2], argc - 3, argv + 3);
+	}
+	if (!strcmp(argv[1], "atlas")) {
+		if (argc < 3) usage(argv[0]);
+		options_t opt = default_options();
+		opt.view.view = 0;
+		if (!parse_args(&opt, argc - 3, argv + 3)) usage(argv[0]);
+		finish_options(&opt, argv[0]);
+		return atlas(argv[2], &opt);
+	}
+	if (!strcmp(argv[1], "poster")) {
+		if (argc < 3) usage(argv[0]);
+		options_t opt = default_options();
+		if (!parse_args(&opt, argc - 3, argv + 3)) usage(argv[0]);
+		finish_options(&opt, argv[0]);
+		return poster(argv[2], &opt);
+	}
+	options_t opt = default_options();
+	if (!parse_args(&opt, argc - 2, argv + 2)) usage(argv[0]);
+	finish_options(&opt, argv[0]);
+	if (!strcmp(argv[1], "census")) {
+		return census(&opt);
+	}
+	if (!strcmp(argv[1], "image")) {
+		return image(&opt);
+	}
+	usage(argv[0]);
+	return 1;
+}
@@ -0,0 +1,558 @@
+#ifndef IC_RENDER_H
+#define IC_RENDER_H
+// Period maps of the integer circle rendered on the CPU, in tiles
+
+#include <stddef.h>
+#include <stdint.h>
+#include "integer_circle.h"
+
+/// The period of an orbit that did not close within the iteration cap
+#define IC_OPEN 0
+
+/// The kernels of the explorer
+typedef enum {
+	IC_FLOAT, // floats, like frag.glsl
+	IC_FIXED, // parameters in fixed point and integer points, like frag_int.glsl
+	IC_DEEP, // the d/e plane with the parameters in double precision,
+	         // like frag_deep.glsl
+} ic_kernel_t;
+
+/// An image of one of the views of the explorer. The pixels map to the plane
+/// the way the shaders map the fragments, in floats.
+typedef struct {
+	uint32_t view; // 1 for the x/y plane, 0 for the d/e plane
+	float delta; // parameters of the x/y plane
+	float epsilon;
+	point_t p; // starting point of the d/e plane
+	ic_kernel_t kernel;
+	int width; // size of the whole image
+	int height;
+	point_t cam; // the center of the image is at -(cam + cam_lo)
+	point_t cam_lo; // rounding error of cam, used by IC_DEEP and by IC_FIXED
+	                // in the x/y plane
+	float zoom; // pixels per unit
+	size_t max_iters;
+} ic_view_t;
+
+/// The work done by a renderer
+typedef struct {
+	size_t iterated; // points whose orbits were computed
+	size_t filled; // points filled in without computing their orbits
+	size_t blocks; // blocks filled at once by interval tracing
+	uint64_t iterations; // steps of all the computed and traced orbits
+} ic_stats_t;
+
+/// The methods of rendering tiles. IC_TRACE computes the borders of its
+/// rectangles together in the lanes of IC_NAIVE, so it is no slower where
+/// it fills nothing. IC_INTERVAL leaves the blocks it cannot fill to the
+/// lanes once they are small, and pays off deep into the d/e plane.
+typedef enum {
+	IC_NAIVE, // compute every point
+	IC_TRACE, // fill rectangles with uniform borders (Mariani-Silver),
+	          // which misses the islands within them
+	IC_INTERVAL, // fill blocks of the d/e plane whose orbits provably agree,
+	             // the same as IC_TRACE in the x/y plane
+} ic_method_t;
+
+/// The length of the orbit of p, or IC_OPEN if it is longer than max_iters.
+/// The steps taken are added to iterations.
+uint32_t ic_period(point_t p, const float delta, const float epsilon,
+		   size_t max_iters, uint64_t* iterations);
+
+/// ic_period with the parameters in double precision
+uint32_t ic_period_deep(point_t p, const double delta, const double epsilon,
+			size_t max_iters, uint64_t* iterations);
+
+/// ic_period with the integer kernel
+uint32_t ic_period_fixed(ipoint_t p, const int32_t delta, const int32_t epsilon,
+			 size_t max_iters, uint64_t* iterations);
+
+/// The coordinates of the center of the pixel (i, j), counted from the top
+/// left, in the plane of the view
+void ic_coords(const ic_view_t* view, int i, int j, double* x, double* y);
+
+/// Whether all delta in [d0, d1] and epsilon in [e0, e1] take the orbit of p
+/// through the same points. The products are monotonic in the parameters
+/// even when rounded, so only the floors of the bounds need to agree.
+/// If they do, the common period is stored into period.
+bool ic_certify(point_t p, float d0, float d1, float e0, float e1,
+		size_t max_iters, uint32_t* period, uint64_t* iterations);
+
+/// The period at the center of the pixel (i, j) of the view
+uint32_t ic_render_pixel(const ic_view_t* view, int i, int j, ic_stats_t* stats);
+
+/// Render the w x h pixels of the view from (x, y) into out, whose rows
+/// are stride apart. The tile starts at out, not at out + y*stride + x.
+/// The integer kernel has no interval method and traces the borders.
+void ic_render_tile(const ic_view_t* view, ic_method_t method, uint32_t* out,
+		    size_t stride, int x, int y, int w, int h, ic_stats_t* stats);
+
+#endif // IC_RENDER_H
+
+#ifdef IC_RENDER_IMPLEMENTATION
+#include <math.h>
+#include <stdlib.h>
+
+#define IC_UNKNOWN UINT32_MAX // not rendered yet
+#define IC_QUEUED (UINT32_MAX - 1) // waiting for the lanes
+#define IC_TRACE_MIN_AREA 16 // rectangles computed without subdividing
+#define IC_TRACE_MIN_ZOOM 6 // pixels per cell of the x/y plane worth tracing
+#define IC_TRACE_MIXED_AREA 256 // rectangles computed whole if their border is mixed
+#define IC_INTERVAL_MIN_SIDE 8 // blocks left to the lanes rather than split
+#define IC_LANES 16 // orbits the naive renderer iterates side by side
+#define IC_LANE_STEPS 32 // steps between refilling the lanes whose orbits ended
+
+uint32_t ic_period(point_t p, const float delta, const float epsilon,
+		   size_t max_iters, uint64_t* iterations) {
+	const point_t orig = p;
+	for (size_t len = 1; len <= max_iters; len++) {
+		p = ic_iter(p, delta, epsilon);
+		if (p.x == orig.x && p.y == orig.y) {
+			*iterations += len;
+			return len;
+		}
+	}
+	*iterations += max_iters;
+	return IC_OPEN;
+}
+
+uint32_t ic_period_deep(point_t p, const double delta, const double epsilon,
+			size_t max_iters, uint64_t* iterations) {
+	const point_t orig = p;
+	for (size_t len = 1; len <= max_iters; len++) {
+		p = ic_iter_deep(p, delta, epsilon);
+		if (p.x == orig.x && p.y == orig.y) {
+			*iterations += len;
+			return len;
+		}
+	}
+	*iterations += max_iters;
+	return IC_OPEN;
+}
+
+uint32_t ic_period_fixed(ipoint_t p, const int32_t delta, const int32_t epsilon,
+			 size_t max_iters, uint64_t* iterations) {
+	const ipoint_t orig = p;
+	for (size_t len = 1; len <= max_iters; len++) {
+		p = ic_iter_fixed(p, delta, epsilon);
+		if (p.x == orig.x && p.y == orig.y) {
+			*iterations += len;
+			return len;
+		}
+	}
+	*iterations += max_iters;
+	return IC_OPEN;
+}
+
+void ic_coords(const ic_view_t* view, int i, int j, double* x, double* y) {
+	// The rows of the fragments count from the bottom, the y axis points down
+	const float sx = (i + 0.5f) - 0.5f * view->width;
+	const float sy = -((view->height - j - 0.5f) - 0.5f * view->height);
+	const float ox = sx / view->zoom, oy = sy / view->zoom;
+	if (view->kernel == IC_DEEP) {
+		// The offset joins the low part of the camera, the sum of the
+		// pair of floats is exact in double
+		*x = (float) (ox - view->cam_lo.x) - (double) view->cam.x;
+		*y = (float) (oy - view->cam_lo.y) - (double) view->cam.y;
+	} else if (view->kernel == IC_FIXED && view->view) {
+		// The cell of the camera adds exactly, like in frag_int.glsl
+		const float cx = floorf(-view->cam.x), cy = floorf(-view->cam.y);
+		*x = cx + (double) (ox + ((-view->cam.x - cx) - view->cam_lo.x));
+		*y = cy + (double) (oy + ((-view->cam.y - cy) - view->cam_lo.y));
+	} else {
+		*x = (float) (ox - view->cam.x);
+		*y = (float) (oy - view->cam.y);
+	}
+}
+
+uint32_t ic_render_pixel(const ic_view_t* view, int i, int j, ic_stats_t* stats) {
+	double x, y;
+	ic_coords(view, i, j, &x, &y);
+	stats->iterated++;
+	if (view->view) {
+		if (view->kernel == IC_FIXED) {
+			return ic_period_fixed((ipoint_t){ floor(x), floor(y) }, ic_fixed(view->delta),
+					       ic_fixed(view->epsilon), view->max_iters,
+					       &stats->iterations);
+		}
+		const point_t p = { floor(x), floor(y) };
+		return ic_period(p, view->delta, view->epsilon, view->max_iters,
+				 &stats->iterations);
+	}
+	switch (view->kernel) {
+		case IC_DEEP:
+			return ic_period_deep(view->p, x, y, view->max_iters, &stats->iterations);
+		case IC_FIXED:
+			return ic_period_fixed((ipoint_t){ view->p.x, view->p.y }, ic_fixed(x),
+					       ic_fixed(y), view->max_iters, &stats->iterations);
+		default:
+			return ic_period(view->p, x, y, view->max_iters, &stats->iterations);
+	}
+}
+
+typedef struct {
+	const ic_view_t* view;
+	uint32_t* out;
+	size_t stride;
+	int x, y;
+	ic_stats_t* stats;
+} ic_tile_t;
+
+/// floor(a * b) with the product rounded to float like ic_iter does,
+/// or to double when deep. The product of floats is exact in double.
+static inline double ic_floor_mul(double a, float b, bool deep) {
+	const double p = a * b;
+	return floor(deep ? p : (float) p);
+}
+
+/// Certify the rest of the orbit of orig from the point p after len steps.
+/// On failure, p and len are left at the last point common to all the
+/// parameters, where the certification of a part of the block can resume.
+static inline bool ic_certify_from(point_t orig, point_t* p, size_t* len,
+			    double d0, double d1, double e0, double e1, bool deep,
+			    size_t max_iters, uint32_t* period, uint64_t* iterations) {
+	while (*len < max_iters) {
+		point_t q = *p;
+		const double x = ic_floor_mul(d0, q.y, deep);
+		if (x != ic_floor_mul(d1, q.y, deep)) return false;
+		q.x -= x;
+		const double y = ic_floor_mul(e0, q.x, deep);
+		if (y != ic_floor_mul(e1, q.x, deep)) return false;
+		q.y += y;
+		const double x2 = ic_floor_mul(d0, q.y, deep);
+		if (x2 != ic_floor_mul(d1, q.y, deep)) return false;
+		q.x -= x2;
+
+		*p = q;
+		(*len)++;
+		(*iterations)++;
+		if (q.x == orig.x && q.y == orig.y) {
+			*period = *len;
+			return true;
+		}
+	}
+	*period = IC_OPEN;
+	return true;
+}
+
+bool ic_certify(point_t p, float d0, float d1, float e0, float e1,
+		size_t max_iters, uint32_t* period, uint64_t* iterations) {
+	size_t len = 0;
+	return ic_certify_from(p, &p, &len, d0, d1, e0, e1, false, max_iters, period,
+			       iterations);
+}
+
+/// Render the block of the d/e plane with the inclusive corners (x0, y0)
+/// and (x1, y1), filling it at once if all its pixels share the orbit.
+/// The orbit is common to the block up to the point p after len steps.
+/// The pixels of small blocks that do not are queued into batch, as indices
+/// j*w + i, for the lanes.
+static void ic_interval(const ic_tile_t* t, int x0, int y0, int x1, int y1,
+			point_t p, size_t len, int* batch, int* n, int w) {
+	// The parameters at the pixel centers of the corners
+	const ic_view_t* v = t->view;
+	double d0, d1, e0, e1;
+	ic_coords(v, t->x + x0, t->y + y0, &d0, &e0);
+	ic_coords(v, t->x + x1, t->y + y1, &d1, &e1);
+	uint32_t period;
+	// Separate copies for both precisions keep the branch out of the loop
+	const bool certified = v->kernel == IC_DEEP
+		? ic_certify_from(v->p, &p, &len, d0, d1, e0, e1, true,
+				  v->max_iters, &period, &t->stats->iterations)
+		: ic_certify_from(v->p, &p, &len, d0, d1, e0, e1, false,
+				  v->max_iters, &period, &t->stats->iterations);
+	if (x0 == x1 && y0 == y1) {
+		// A single pixel always is
+		t->out[y0 * t->stride + x0] = period;
+		t->stats->iterated++;
+		return;
+	}
+	if (certified) {
+		for (int j = y0; j <= y1; j++) {
+			uint32_t* row = t->out + j * t->stride;
+			for (int i = x0; i <= x1; i++) {
+				row[i] = period;
+			}
+		}
+		t->stats->filled += (x1 - x0 + 1) * (y1 - y0 + 1);
+		t->stats->blocks++;
+		return;
+	}
+	if (x1 - x0 < IC_INTERVAL_MIN_SIDE && y1 - y0 < IC_INTERVAL_MIN_SIDE) {
+		// Certifying smaller blocks costs more than the lanes
+		for (int j = y0; j <= y1; j++) {
+			for (int i = x0; i <= x1; i++) {
+				batch[(*n)++] = j * w + i;
+			}
+		}
+		return;
+	}
+
+	// Split into quarters, or halves of a line
+	const int mx = (x0 + x1) / 2, my = (y0 + y1) / 2;
+	ic_interval(t, x0, y0, mx, my, p, len, batch, n, w);
+	if (mx < x1) ic_interval(t, mx + 1, y0, x1, my, p, len, batch, n, w);
+	if (my < y1) ic_interval(t, x0, my + 1, mx, y1, p, len, batch, n, w);
+	if (mx < x1 && my < y1) ic_interval(t, mx + 1, my + 1, x1, y1, p, len, batch, n, w);
+}
+
+/// Orbits iterated side by side, laid out for SIMD instructions. Each lane
+/// iterates the orbit of a pixel until it closes or reaches the cap, then
+/// takes the next pixel.
+typedef struct {
+	// Points, starting points and parameters of the float kernel
+	float x[IC_LANES], y[IC_LANES], x0[IC_LANES], y0[IC_LANES];
+	float d[IC_LANES], e[IC_LANES];
+	// The same for the integer kernel
+	int32_t ix[IC_LANES], iy[IC_LANES], ix0[IC_LANES], iy0[IC_LANES];
+	int32_t id[IC_LANES], ie[IC_LANES];
+	uint32_t len[IC_LANES]; // steps taken
+	uint32_t closed[IC_LANES]; // whether the orbit got back to the start
+	int pixel[IC_LANES]; // index in the tile, or -1 when idle
+} ic_lanes_t;
+
+/// IC_LANE_STEPS steps of the float kernel in all lanes, the same as ic_iter.
+/// The lanes that are done keep iterating without counting the steps.
+static void ic_lanes_float(ic_lanes_t* l, uint32_t max_iters) {
+	for (int s = 0; s < IC_LANE_STEPS; s++) {
+		for (int k = 0; k < IC_LANES; k++) {
+			float x = l->x[k], y = l->y[k];
+			x -= floorf(l->d[k] * y);
+			y += floorf(l->e[k] * x);
+			x -= floorf(l->d[k] * y);
+			l->x[k] = x;
+			l->y[k] = y;
+			const uint32_t active = !l->closed[k] & (l->len[k] < max_iters);
+			l->len[k] += active;
+			l->closed[k] |= active & (x == l->x0[k]) & (y == l->y0[k]);
+		}
+	}
+}
+
+/// The same with the integer kernel
+static void ic_lanes_fixed(ic_lanes_t* l, uint32_t max_iters) {
+	for (int s = 0; s < IC_LANE_STEPS; s++) {
+		for (int k = 0; k < IC_LANES; k++) {
+			const ipoint_t p = ic_iter_fixed((ipoint_t){ l->ix[k], l->iy[k] },
+							 l->id[k], l->ie[k]);
+			l->ix[k] = p.x;
+			l->iy[k] = p.y;
+			const uint32_t active = !l->closed[k] & (l->len[k] < max_iters);
+			l->len[k] += active;
+			l->closed[k] |= active & (p.x == l->ix0[k]) & (p.y == l->iy0[k]);
+		}
+	}
+}
+
+/// Start the orbit of the pixel at index in the lane k, or leave it idle
+static void ic_lane_start(const ic_tile_t* t, ic_lanes_t* l, int k, int index, int w) {
+	const ic_view_t* v = t->view;
+	l->pixel[k] = index;
+	l->len[k] = 0;
+	l->closed[k] = 0;
+	double x = 0, y = 0;
+	point_t p = { 0, 0 };
+	float d = 0, e = 0;
+	if (index >= 0) {
+		ic_coords(v, t->x + index % w, t->y + index / w, &x, &y);
+		if (v->view) {
+			p = (point_t){ floor(x), floor(y) };
+			d = v->delta;
+			e = v->epsilon;
+		} else {
+			p = v->p;
+			d = x;
+			e = y;
+		}
+	}
+	l->x[k] = l->x0[k] = p.x;
+	l->y[k] = l->y0[k] = p.y;
+	l->d[k] = d;
+	l->e[k] = e;
+	if (v->kernel == IC_FIXED) {
+		// The float kernel takes the parameters beyond the fixed point,
+		// and the points of the x/y plane are exact out to 2^31
+		l->ix[k] = l->ix0[k] = v->view ? floor(x) : p.x;
+		l->iy[k] = l->iy0[k] = v->view ? floor(y) : p.y;
+		l->id[k] = ic_fixed(d);
+		l->ie[k] = ic_fixed(e);
+	}
+}
+
+/// The index of the next pixel to compute, or -1 after the last
+static inline int ic_next_pixel(const int* pixels, int n, int* next) {
+	if (*next >= n) return -1;
+	const int p = (*next)++;
+	return pixels ? pixels[p] : p;
+}
+
+/// Compute the n pixels of the tile at the indices j*w + i in pixels, or
+/// the first n pixels of the tile if pixels is NULL, several orbits at a time
+static void ic_compute(const ic_tile_t* t, const int* pixels, int n, int w) {
+	const ic_view_t* v = t->view;
+	int next = 0;
+	if (v->kernel == IC_DEEP) {
+		for (int index; (index = ic_next_pixel(pixels, n, &next)) >= 0; ) {
+			const int i = index % w, j = index / w;
+			t->out[j * t->stride + i] = ic_render_pixel(v, t->x + i, t->y + j, t->stats);
+		}
+		return;
+	}
+	ic_lanes_t l;
+	int busy = 0;
+	for (int k = 0; k < IC_LANES; k++) {
+		ic_lane_start(t, &l, k, ic_next_pixel(pixels, n, &next), w);
+		busy += l.pixel[k] >= 0;
+	}
+	while (busy) {
+		if (v->kernel == IC_FIXED) {
+			ic_lanes_fixed(&l, v->max_iters);
+		} else {
+			ic_lanes_float(&l, v->max_iters);
+		}
+		for (int k = 0; k < IC_LANES; k++) {
+			const int index = l.pixel[k];
+			if (index < 0 || (!l.closed[k] && l.len[k] < v->max_iters)) continue;
+			t->out[index / w * t->stride + index % w] = l.closed[k] ? l.len[k] : IC_OPEN;
+			t->stats->iterated++;
+			t->stats->iterations += l.len[k];
+			ic_lane_start(t, &l, k, ic_next_pixel(pixels, n, &next), w);
+			busy -= l.pixel[k] < 0;
+		}
+	}
+}
+
+/// A rectangle of the tile with the inclusive corners (x0, y0) and (x1, y1)
+typedef struct {
+	int x0, y0, x1, y1;
+	bool whole; // computed without tracing
+} ic_rect_t;
+
+/// Whether the rectangle is too small to trace
+static bool ic_trace_small(const ic_rect_t* r) {
+	return r->x1 - r->x0 < 2 || r->y1 - r->y0 < 2
+		|| (r->x1 - r->x0 - 1) * (r->y1 - r->y0 - 1) <= IC_TRACE_MIN_AREA;
+}
+
+/// The pixels of the border of the rectangle, already computed, that differ
+/// from its first corner
+static int ic_border_mismatches(const ic_tile_t* t, const ic_rect_t* r) {
+	const uint32_t* top = t->out + r->y0 * t->stride;
+	const uint32_t* bottom = t->out + r->y1 * t->stride;
+	const uint32_t period = top[r->x0];
+	int mismatches = 0;
+	for (int i = r->x0; i <= r->x1; i++) {
+		mismatches += (top[i] != period) + (bottom[i] != period);
+	}
+	for (int j = r->y0 + 1; j < r->y1; j++) {
+		const uint32_t* row = t->out + j * t->stride;
+		mismatches += (row[r->x0] != period) + (row[r->x1] != period);
+	}
+	return mismatches;
+}
+
+/// Render the w x h tile by tracing the borders of rectangles. If the border
+/// has a single period, so does the inside, unless an island of other
+/// periods hides in it, and otherwise the rectangle splits along its longer
+/// side. The rectangles go a level of splits at a time, the pixels of all
+/// their borders computed together in the lanes.
+static void ic_trace(const ic_tile_t* t, int w, int h) {
+	int* batch = malloc(w * h * sizeof(*batch));
+	ic_rect_t* rects = malloc(2 * w * h * sizeof(*rects));
+	ic_rect_t* split = rects + w * h;
+	rects[0] = (ic_rect_t){ 0, 0, w - 1, h - 1, false };
+	int count = 1;
+	while (count > 0) {
+		// The borders share their pixels, which are queued once
+		int n = 0;
+		for (int r = 0; r < count; r++) {
+			const ic_rect_t* c = &rects[r];
+			const bool whole = c->whole || ic_trace_small(c);
+			for (int j = c->y0; j <= c->y1; j++) {
+				const bool edge = whole || j == c->y0 || j == c->y1;
+				for (int i = c->x0; i <= c->x1; i += edge ? 1 : c->x1 - c->x0) {
+					uint32_t* v = t->out + j * t->stride + i;
+					if (*v == IC_UNKNOWN) {
+						*v = IC_QUEUED;
+						batch[n++] = j * w + i;
+					}
+				}
+			}
+		}
+		ic_compute(t, batch, n, w);
+
+		int next = 0;
+		for (int r = 0; r < count; r++) {
+			const ic_rect_t c = rects[r];
+			if (c.whole || ic_trace_small(&c)) continue;
+			const int mismatches = ic_border_mismatches(t, &c);
+			if (!mismatches) {
+				const uint32_t period = t->out[c.y0 * t->stride + c.x0];
+				for (int j = c.y0 + 1; j < c.y1; j++) {
+					uint32_t* row = t->out + j * t->stride;
+					for (int i = c.x0 + 1; i < c.x1; i++) {
+						if (row[i] == IC_UNKNOWN) {
+							row[i] = period;
+							t->stats->filled++;
+						}
+					}
+				}
+			} else if ((c.x1 - c.x0) * (c.y1 - c.y0) <= IC_TRACE_MIXED_AREA
+				   && mismatches > c.x1 - c.x0 + c.y1 - c.y0) {
+				// A border of mostly mixed periods leaves little to fill
+				split[next] = c;
+				split[next++].whole = true;
+			} else if (c.x1 - c.x0 >= c.y1 - c.y0) {
+				// The halves share the middle line
+				const int mid = (c.x0 + c.x1) / 2;
+				split[next++] = (ic_rect_t){ c.x0, c.y0, mid, c.y1, false };
+				split[next++] = (ic_rect_t){ mid, c.y0, c.x1, c.y1, false };
+			} else {
+				const int mid = (c.y0 + c.y1) / 2;
+				split[next++] = (ic_rect_t){ c.x0, c.y0, c.x1, mid, false };
+				split[next++] = (ic_rect_t){ c.x0, mid, c.x1, c.y1, false };
+			}
+		}
+		ic_rect_t* swap = rects;
+		rects = split;
+		split = swap;
+		count = next;
+	}
+	free(batch);
+	free(rects < split ? rects : split);
+}
+
+void ic_render_tile(const ic_view_t* view, ic_method_t method, uint32_t* out,
+		    size_t stride, int x, int y, int w, int h, ic_stats_t* stats) {
+	if (w <= 0 || h <= 0) return;
+	const ic_tile_t t = { view, out, stride, x, y, stats };
+	for (int j = 0; j < h; j++) {
+		for (int i = 0; i < w; i++) {
+			out[j * stride + i] = IC_UNKNOWN;
+		}
+	}
+	switch (method) {
+		case IC_INTERVAL:
+			if (!view->view && view->kernel != IC_FIXED) {
+				int* batch = malloc(w * h * sizeof(*batch));
+				int n = 0;
+				ic_interval(&t, 0, 0, w - 1, h - 1, view->p, 0, batch, &n, w);
+				ic_compute(&t, batch, n, w);
+				free(batch);
+				break;
+			}
+			// fall through
+		case IC_TRACE:
+			// Narrow cells of the x/y plane leave no border of a single period
+			if (!view->view || view->zoom >= IC_TRACE_MIN_ZOOM) {
+				ic_trace(&t, w, h);
+				break;
+			}
+			// fall through
+		default:
+			ic_compute(&t, NULL, w * h, w);
+			break;
+	}
+}
+
+#endif // IC_RENDER_IMPLEMENTATION
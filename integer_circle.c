@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <complex.h>
+#include <string.h>
 
 #include "sokol/sokol_app.h"
 #include "sokol/sokol_gfx.h"
@@ -11,18 +12,53 @@
 #include "sokol/sokol_debugtext.h"
 #include "sokol/sokol_log.h"
 #include "sokol/rfft.h"
+#include "shaders.h"
+#if !defined(__EMSCRIPTEN__)
+	// Timer and occlusion queries and reading back images, which sokol
+	// does not wrap, on the GL backend. WebGL has no timestamps, the web
+	// build only times whole frames, iterates the fractal up to the cap,
+	// and it has no files to save the images in.
+	#define GL_GLEXT_PROTOTYPES
+	#include <GL/gl.h>
+	#define GPU_TIMERS
+	#define GPU_OCCLUSION
+	#define GPU_READBACK
+#endif
+#define INTEGER_CIRCLE_IMPLEMENTATION
+#include "integer_circle.h"
+#define IC_CACHE_IMPLEMENTATION
+#include "ic_cache.h"
 
-#define MAX_FREQ 3200
 #define MAX_ITERS 16384
+#define ITER_SLICE 512 // iterations per frame
+#define MAX_STRIDE 8 // grid of the pixels the refinement starts first
+#define PIXEL_BUDGET (1 << 16) // pixels the refinement starts per frame
+#define FRAME_TARGET 0.008 // seconds per frame to aim for while the view changes
+#define MIN_SCALE 2 // lowest resolution of the fractal, in eighths of the window
+#define IDLE_FRAMES 8 // frames without changes before rendering at full resolution
+#define PALETTE_WIDTH 256 // entries in a row of the palette texture, of IC_PALETTE_SIZE
+#define TIMER_FRAMES 4 // frames of timer queries in flight
+#define TIMER_HISTORY 128 // frames of timings the averages are taken over
+#define SAVE_FILE "integer_circle.ppm" // image of the fractal saved by P
+#define CACHE_MB 256 // memory for the finished tiles of the fractal by default
+#define ATLAS_FILE "integer_circle.atlas" // tiles made by ic_render atlas, if present
+#define MAX_PEAKS 16
+#define PEAK_THRESHOLD 0.05
 
+/// Status of the orbit of a pixel in the targets, as in the shaders
+enum { RUNNING, CLOSED, WAITING };
+
+/// A local maximum of the orbit spectrum
 typedef struct {
-	float x;
-	float y;
-} point_t;
+	float freq; // interpolated bin index
+	float mag;  // interpolated magnitude
+} peak_t;
 
 typedef struct {
 	point_t resolution;
 	point_t cam;
+	point_t cam_lo; // rounding error of cam, for deep zooms into the d/e plane
+	                // and for the integer kernel far away in the x/y plane
 	float zoom;
 	float delta;
 	float epsilon;
@@ -31,38 +67,148 @@ typedef struct {
 	uint32_t color;
 } params_t;
 
+/// A point of the d/e plane in double precision
+typedef struct {
+	double x;
+	double y;
+} dpoint_t;
+
+/// Mapping of screen pixels to the texture coordinates of the fractal
+/// and to the entries of the palette
+typedef struct {
+	point_t scale;
+	point_t offset;
+	uint32_t step; // iterations per entry of the palette
+	uint32_t grid[2]; // origin of the grids of the refinement
+} blit_t;
+
+/// The parts of a frame timed on the GPU
+typedef enum {
+	PASS_FRACTAL, // iterating the orbits offscreen
+	PASS_COLOR, // coloring them on the screen
+	PASS_ORBIT, // the selected orbit drawn by sokol-gl
+	PASS_TEXT, // the help or the info and the timings
+	NUM_PASSES,
+} pass_t;
+
+static const char* PASSES[NUM_PASSES] = { "fractal", "color", "orbit", "text" };
+
+/// Uniforms of the iteration pass
+typedef struct {
+	params_t params;
+	uint32_t start; // start the orbits instead of continuing them
+	uint32_t iters; // cap on the number of iterations
+	uint32_t stride; // grid of the pixels to start
+	uint32_t rows[2]; // range of the rows to start them in
+	uint32_t grid[2]; // origin of the grid
+} iterate_t;
+
 typedef struct {
 	params_t params;
 	float other_zoom;
+	uint32_t iters;
+	ic_palette_t palettes[16]; // loaded color schemes after the built-in ones
+	const char* palette_files[16];
+	size_t num_palettes;
+	size_t cache_mb;
+	ic_atlas_t* atlas; // tiles of the d/e plane rendered ahead of time
 	float audio_buffer[16384];
-	point_t play_pt;
-	float volume;
-	float start_volume;
-	bool dampen;
+	ic_synth_t synth; // the audio of the orbits
 	float octave;
 	bool move;
 	point_t pointer;
 	bool show_info;
 	bool show_help;
+	bool show_timings;
+	bool save_fractal;
 	bool params_changed;
 	bool smooth_change;
-	point_t orbit[MAX_ITERS];
+	struct {
+		float x[MAX_ITERS];
+		float y[MAX_ITERS];
+	} orbit;
 	float complex spectrum[MAX_ITERS];
+	fft_plan* fft;
 	size_t orbit_len;
-	float radius;
+	peak_t peaks[MAX_PEAKS];
+	size_t num_peaks;
 	struct {
-    		point_t p;
     		float delta;
     		float epsilon;
     		float radius;
-    		float volume;
 	} old;
 	struct {
-		sg_pipeline pip;
+		sg_pipeline pip[2]; // by view
+		sg_pipeline float_pip[2]; // the float kernel, pip unless int_kernel
+		sg_pipeline deep_pip; // view 0 beyond the precision of floats
+		bool int_kernel; // pip runs the integer kernel
 		sg_bindings bind;
 		sg_pass_action pass_action;
 		sgl_pipeline sgl_alpha_pip;
+		// Offscreen images of the iteration state of every pixel, colored
+		// on the way to the screen. Each frame continues the orbits of the
+		// previous image by another slice until the cap is reached, and
+		// the previous image is also reused when the view is panned.
+		sg_image target[2];
+		sg_pass target_pass[2];
+		int current;
+		sg_pipeline color_pip;
+		// The colors of the iteration counts, rebuilt on the CPU when
+		// the color scheme or the cap on the iterations changes
+		sg_image palette;
+		uint32_t palette_color;
+		uint32_t palette_iters;
+		sg_pipeline copy_pip;
+		sg_bindings blit_bind;
+		params_t target_params;
+		bool target_valid;
+		// The finished tiles of both views, read back once the fractal
+		// is done. Starting the fractal over takes the tiles it finds
+		// in the cache or in the atlas as the state of their orbits.
+		ic_cache_t* cache;
+		sg_image cache_image;
+		int32_t* texels; // of a target, to read back and to upload
+		bool stored; // the target is done and in the cache
+		bool cached; // the target has orbits from the cache
+		uint32_t iterated; // iterations done on the most recent pixels
+		// An occlusion query over the target counts the orbits that still
+		// run below the cap or wait to start, read back once the GPU got
+		// to it. The fractal is done when there are none, before the cap.
+		sg_pipeline count_pip;
+		uint32_t count_query;
+		bool counting; // the query is in flight
+		uint32_t generation; // of the orbits, new when they start over or move
+		uint32_t counted[2]; // generation and cap of the query
+		uint32_t finished; // cap below which all the orbits are done
+		// The refinement starts the pixels on finer and finer grids,
+		// a band of rows at a time. The grids move along when panning.
+		int stride; // 0 once all pixels are started
+		int row;
+		int grid[2];
+		blit_t blit;
+		// The fraction of the window resolution the fractal renders at,
+		// lowered while the view changes if the frames take too long
+		float render_scale;
+		int scale; // in eighths, learned while the view changes
+		int settle; // frames since the scale last changed
+		int idle; // frames since the view last changed
+		double min_duration; // of the frames without work on the fractal
+		params_t last_params;
 	} gfx;
+	// Timestamps taken between the passes of a frame and read back a few
+	// frames later, once the GPU got to them, into a history of timings
+	struct {
+		uint32_t queries[TIMER_FRAMES][NUM_PASSES + 1];
+		bool pending[TIMER_FRAMES];
+		uint64_t frame[TIMER_FRAMES];
+		float duration[TIMER_FRAMES]; // of the frame on the CPU
+		int slot;
+		bool marked; // the frame sets timestamps
+		float ms[TIMER_HISTORY][NUM_PASSES + 1]; // the frame last
+		size_t count;
+		size_t dropped; // frames whose timestamps came too late
+		FILE* csv;
+	} timers;
 } state_t;
 
 static state_t state = (state_t){
@@ -77,25 +223,49 @@ static state_t state = (state_t){
 		.color = 0,
 	},
 	.other_zoom = 5000,
-	.volume = 1.0,
-	.start_volume = 1.0,
-	.dampen = false,
+	.iters = MAX_ITERS,
+	.cache_mb = CACHE_MB,
+	.gfx = {
+		.render_scale = 1.0,
+		.scale = 8,
+		.min_duration = FRAME_TARGET,
+	},
+	.synth = {
+		.volume = 1.0,
+		.start_volume = 1.0,
+		.dampen = false,
+		.old_volume = 0.0,
+	},
 	.octave = 1.0,
 	.move = false,
 	.show_info = false,
 	.show_help = true,
 	.params_changed = false,
 	.smooth_change = false,
-	.old = {
-		.p = { 0, 0 },
-		.volume = 0.0,
-	}
 };
 
-const char *VERTEX_SHADER = "#version 100\n"
-	"attribute vec4 pos;"
+const char *VERTEX_SHADER = "#version 300 es\n"
+	"in vec4 pos;"
 	"void main() { gl_Position = pos; }";
 
+const char *COPY_SHADER = "#version 300 es\n"
+	"uniform highp isampler2D periods;"
+	"uniform highp vec2 iScale;"
+	"uniform highp vec2 iOffset;"
+	"out highp ivec4 next;"
+	"void main() { next = texture(periods, gl_FragCoord.xy * iScale + iOffset); }";
+
+/// Keeps the pixels whose orbits run below the cap or wait to start, for
+/// the occlusion query that tells whether there are any left
+const char *COUNT_SHADER = "#version 300 es\n"
+	"uniform highp isampler2D state;"
+	"uniform int iIters;"
+	"out highp ivec4 next;"
+	"void main() {"
+	"  next = texelFetch(state, ivec2(gl_FragCoord.xy), 0);"
+	"  if (next.w == 1 || (next.w == 0 && next.z >= iIters)) discard;"
+	"}";
+
 const char *HELP = "Left mouse - click to hear orbits\n"
 		   "Middle/Shift + mouse - drag the view\n"
 		   "Right mouse - toggle x/y and d/e view\n"
@@ -104,7 +274,10 @@ const char *HELP = "Left mouse - click to hear orbits\n"
 		   "I - toggle info screen\n"
 		   "R - reset view\n"
 		   "M - toggle moving along the period\n"
-		   "C - change the color scheme\n\n"
+		   "C - change the color scheme\n"
+		   "J/K - halve/double the iterations\n"
+		   "T - toggle frame timings\n"
+		   "P - save the fractal for ic_render\n\n"
 		   "Space - stop the audio\n"
 		   "D - toggle audio dampening\n\n"
 		   "Keyboard:\n"
@@ -113,36 +286,6 @@ const char *HELP = "Left mouse - click to hear orbits\n"
 		   "E/. - increase by octave\n"
 		   "W/, - decrease by octave";
 
-/// Ratios of the musical notes in just intonation
-const float NOTES[10] = { 4.0/6.0, 3.0/4.0, 8.0/10.0, 5.0/6.0, 9.0/10.0,
-                           1.0, 9.0/8.0, 6.0/5.0, 5.0/4.0, 4.0/3.0};
-
-/// One iteration of the integer circle algorithm
-point_t ic_iter(point_t p, const float delta, const float epsilon) {
-	p.x -= floor(delta * p.y);
-	p.y += floor(epsilon * p.x);
-	p.x -= floor(delta * p.y);
-	return p;
-}
-
-/// Calculate the period of oscillation if no flooring was done
-float calculate_period(float delta, float epsilon) {
-    return M_PI / asin(sqrt(delta*epsilon/2));
-}
-
-/// Update the parameters to keep the period constant
-void update_parameter(float* delta, float* epsilon, float change) {
-    const float product = *delta * *epsilon;
-    *delta += change;
-    *epsilon = product / *delta;
-}
-
-/// Calculate the second parameter with the given period
-float other_parameter(float period, float delta) {
-    const float s = sin(M_PI / period);
-    return 2*s*s/delta;
-}
-
 point_t floor_pt(const point_t p) {
 	return (point_t){
 		.x = floor(p.x),
@@ -161,21 +304,41 @@ bool eq_pt(const point_t p, const point_t q) {
 	return (p.x == q.x) && (p.y == q.y);
 }
 
-point_t screen_to_pt(const int x, const int y) {
+/// The camera in double precision
+dpoint_t get_cam() {
+	return (dpoint_t){
+		.x = (double) state.params.cam.x + state.params.cam_lo.x,
+		.y = (double) state.params.cam.y + state.params.cam_lo.y,
+	};
+}
+
+/// Set the camera, keeping what the floats of cam round off in cam_lo
+void set_cam(const double x, const double y) {
+	state.params.cam = (point_t){ x, y };
+	state.params.cam_lo = (point_t){ x - state.params.cam.x, y - state.params.cam.y };
+}
+
+dpoint_t screen_to_dpt(const int x, const int y) {
 	const params_t par = state.params;
-	return (point_t){
-		.x = ((float) x - par.resolution.x / 2) / par.zoom - par.cam.x,
-		.y = ((float) y - par.resolution.y / 2) / par.zoom - par.cam.y,
+	const dpoint_t cam = get_cam();
+	return (dpoint_t){
+		.x = ((double) x - par.resolution.x / 2) / par.zoom - cam.x,
+		.y = ((double) y - par.resolution.y / 2) / par.zoom - cam.y,
 	};
 }
 
-/// Store the old parameters in state.old
+point_t screen_to_pt(const int x, const int y) {
+	const dpoint_t q = screen_to_dpt(x, y);
+	return (point_t){ q.x, q.y };
+}
+
+/// Store the old parameters in state.old, the playing point fades out
 void remember_old_params() {
-	state.old.p = state.play_pt;
+	state.synth.old_p = state.synth.p;
 	state.old.delta = state.params.delta;
 	state.old.epsilon = state.params.epsilon;
-	state.old.radius = state.radius;
-	state.old.volume = state.volume * state.start_volume;
+	state.old.radius = state.synth.radius;
+	state.synth.old_volume = state.synth.volume * state.synth.start_volume;
 }
 
 /// Set the current playing point
@@ -185,14 +348,14 @@ void set_point(point_t p) {
 		point_t floored = floor_pt(p);
 		if (!eq_pt(state.params.p, floored)) {
 			state.params.p = floored;
-			state.play_pt = floored;
+			state.synth.p = floored;
 		}
 	} else {
 		state.params.delta = p.x;
 		state.params.epsilon = p.y;
-		state.play_pt = state.params.p;
+		state.synth.p = state.params.p;
 	}
-	state.volume = 1.0;
+	state.synth.volume = 1.0;
 	state.params_changed = true;
 }
 
@@ -203,8 +366,8 @@ void move_point(point_t q) {
 		point_t floored = floor_pt(q);
 		if (!eq_pt(state.params.p, floored)) {
 			state.params.p = floored;
-			state.play_pt = floored;
-			state.volume = 1.0;
+			state.synth.p = floored;
+			state.synth.volume = 1.0;
 		}
 	} else {
 		state.params.delta = q.x;
@@ -220,8 +383,9 @@ void input(const sapp_event* ev) {
 			const point_t q = screen_to_pt(ev->mouse_x, ev->mouse_y);
 			state.pointer = q;
 			if (ev->modifiers & (SAPP_MODIFIER_MMB | SAPP_MODIFIER_SHIFT)) {
-				state.params.cam.x += ev->mouse_dx / state.params.zoom;
-				state.params.cam.y += ev->mouse_dy / state.params.zoom;
+				const dpoint_t cam = get_cam();
+				set_cam(cam.x + ev->mouse_dx / state.params.zoom,
+					cam.y + ev->mouse_dy / state.params.zoom);
 			} else if (ev->modifiers & SAPP_MODIFIER_LMB) {
 				move_point(q);
 			}
@@ -239,20 +403,19 @@ void input(const sapp_event* ev) {
 					state.other_zoom = tmp;
 					if (state.params.view) {
 						state.params.p = floor_pt(p);
-						state.params.cam.x = state.params.delta;
-						state.params.cam.y = state.params.epsilon;
+						set_cam(state.params.delta, state.params.epsilon);
 					} else {
 						state.params.delta = p.x;
 						state.params.epsilon = p.y;
-						state.params.cam = state.params.p;
+						set_cam(state.params.p.x, state.params.p.y);
 						point_t zpt = (point_t){ 0, 0 };
-						if (eq_pt(state.play_pt, zpt)) {
+						if (eq_pt(state.synth.p, zpt)) {
 							state.params.p = zpt;
 						}
 					}
 					state.params.view = !state.params.view;
-					state.params.cam = screen_to_pt(ev->mouse_x,
-					                                ev->mouse_y);
+					const dpoint_t cam = screen_to_dpt(ev->mouse_x, ev->mouse_y);
+					set_cam(cam.x, cam.y);
 					break;
 				}
 				default:
@@ -261,11 +424,11 @@ void input(const sapp_event* ev) {
 			break;
 		}
 		case SAPP_EVENTTYPE_MOUSE_SCROLL: {
-			const point_t old = screen_to_pt(ev->mouse_x, ev->mouse_y);
+			const dpoint_t old = screen_to_dpt(ev->mouse_x, ev->mouse_y);
 			state.params.zoom *= pow(1.1, ev->scroll_y);
-			const point_t new = screen_to_pt(ev->mouse_x, ev->mouse_y);
-			state.params.cam.x += new.x - old.x;
-			state.params.cam.y += new.y - old.y;
+			const dpoint_t new = screen_to_dpt(ev->mouse_x, ev->mouse_y);
+			const dpoint_t cam = get_cam();
+			set_cam(cam.x + new.x - old.x, cam.y + new.y - old.y);
 			break;
 		case SAPP_EVENTTYPE_TOUCHES_BEGAN:
     			if (ev->num_touches == 1) {
@@ -284,10 +447,11 @@ void input(const sapp_event* ev) {
 		case SAPP_EVENTTYPE_KEY_DOWN:
 			switch (ev->key_code) {
 				case SAPP_KEYCODE_C:
-					state.params.color = !state.params.color;
+					state.params.color = (state.params.color + 1)
+						% (IC_SCHEMES + state.num_palettes);
 					break;
 				case SAPP_KEYCODE_D:
-					state.dampen = !state.dampen;
+					state.synth.dampen = !state.synth.dampen;
 					break;
 				case SAPP_KEYCODE_H:
 					state.show_help = !state.show_help;
@@ -295,19 +459,40 @@ void input(const sapp_event* ev) {
 				case SAPP_KEYCODE_I:
 					state.show_info = !state.show_info;
 					break;
+				case SAPP_KEYCODE_T:
+					state.show_timings = !state.show_timings;
+					break;
+				case SAPP_KEYCODE_P:
+					state.save_fractal = true;
+					break;
 				case SAPP_KEYCODE_M:
 					state.move = !state.move;
 					break;
 				case SAPP_KEYCODE_R:
-					state.params.cam = (point_t){ 0.0, 0.0 };
+					set_cam(0.0, 0.0);
 					state.params.zoom = state.params.view ? 1.0 : 5000.0;
 					break;
+				case SAPP_KEYCODE_J:
+					if (state.iters > ITER_SLICE) {
+						state.iters /= 2;
+						state.gfx.target_valid = false;
+					}
+					break;
+				case SAPP_KEYCODE_K:
+					// The orbits continue from where they were capped,
+					// except the ones from the cache, which start over
+					if (state.iters < (1u << 24)) {
+						state.iters *= 2;
+						state.gfx.target_valid &= !state.gfx.cached;
+					}
+					break;
 				case SAPP_KEYCODE_SPACE:
-					state.play_pt = (point_t){ 0, 0 };
+					state.synth.p = (point_t){ 0, 0 };
 					if (state.params.view) {
 						state.params.p = (point_t){ 0, 0 };
 					}
 					state.orbit_len = 0;
+					state.num_peaks = 0;
 					break;
 				case SAPP_KEYCODE_W:
 				case SAPP_KEYCODE_COMMA:
@@ -326,12 +511,12 @@ void input(const sapp_event* ev) {
 					const float pertrubation = ((float) rand() / (float) RAND_MAX - 0.5) * 0.01;
 					state.params.delta = (float) (rand() % 12 + 1) / (float) (rand() % 16 + 4) + 0.5;
 					state.params.epsilon = other_parameter(period + pertrubation, state.params.delta);
-					state.dampen = false;
-					state.volume = 1.0;
+					state.synth.dampen = false;
+					state.synth.volume = 1.0;
 					if (state.params.view) {
     						const int x = ev->mouse_x, y = ev->mouse_y;
 						state.params.p = floor_pt(screen_to_pt(x, y));
-						state.play_pt = state.params.p;
+						state.synth.p = state.params.p;
 					}
 					state.params_changed = true;
 					break;
@@ -343,7 +528,7 @@ void input(const sapp_event* ev) {
 		case SAPP_EVENTTYPE_KEY_UP:
 			switch(ev->key_code) {
 				case SAPP_KEYCODE_0 ... SAPP_KEYCODE_9:
-					state.dampen = true;
+					state.synth.dampen = true;
 					break;
 				default:
 					break;
@@ -354,6 +539,42 @@ void input(const sapp_event* ev) {
 	}
 }
 
+/// Collect the strongest peaks of the spectrum, sorted by magnitude.
+/// The peak position and height are refined by fitting a parabola
+/// through the magnitudes of the neighbouring bins.
+static void find_peaks() {
+	const size_t n = state.orbit_len;
+	state.num_peaks = 0;
+	for (size_t i = 1; i < n; i++) {
+		const float b = cabsf(state.spectrum[i]);
+		if (b <= PEAK_THRESHOLD) continue;
+		const float a = cabsf(state.spectrum[i - 1]);
+		const float c = cabsf(state.spectrum[(i + 1) % n]);
+		// On a plateau, only the last bin counts as the peak
+		if (b < a || b <= c) continue;
+
+		const float denom = a - 2*b + c;
+		const float d = denom < 0 ? 0.5*(a - c)/denom : 0.0;
+		const peak_t peak = {
+			.freq = (float) i + d,
+			.mag = b - 0.25*(a - c)*d,
+		};
+
+		// Insert into the sorted list, dropping the weakest peak if full
+		size_t j = state.num_peaks;
+		if (j == MAX_PEAKS) {
+			if (peak.mag <= state.peaks[j - 1].mag) continue;
+			j--;
+		} else {
+			state.num_peaks++;
+		}
+		for (; j > 0 && state.peaks[j - 1].mag < peak.mag; j--) {
+			state.peaks[j] = state.peaks[j - 1];
+		}
+		state.peaks[j] = peak;
+	}
+}
+
 static void print_info() {
 	const float period = calculate_period(state.params.delta, state.params.epsilon);
 	if (state.params.view) {
@@ -376,15 +597,107 @@ static void print_info() {
 		sdtx_printf("orbit: %ld\n\n", state.orbit_len);
 	}
 
-	// Print the spectrum
-	for (size_t i = 1; i < state.orbit_len; i++) {
-		if (cabsf(state.spectrum[i]) > 0.05) {
-			const float cycle = (float) state.orbit_len/((float) i);
-			sdtx_printf("%.3f = p/%.3f: %.3f (%.3fHz)\n", cycle, period/cycle,
-				    cabsf(state.spectrum[i]), MAX_FREQ / cycle);
+	// Print the spectral peaks
+	for (size_t i = 0; i < state.num_peaks; i++) {
+		const peak_t peak = state.peaks[i];
+		const float cycle = (float) state.orbit_len / peak.freq;
+		sdtx_printf("%.3f = p/%.3f: %.3f (%.3fHz)\n", cycle, period/cycle,
+			    peak.mag, IC_MAX_FREQ / cycle);
+	}
+}
+
+/// Record the timings of a frame into the history and the CSV file
+static void record_timings(uint64_t frame, const float* ms) {
+	float* row = state.timers.ms[state.timers.count++ % TIMER_HISTORY];
+	memcpy(row, ms, sizeof(state.timers.ms[0]));
+	if (state.timers.csv) {
+		fprintf(state.timers.csv, "%llu", (unsigned long long) frame);
+		for (int i = 0; i <= NUM_PASSES; i++) {
+			fprintf(state.timers.csv, ",%.4f", row[i]);
 		}
+		fputc('\n', state.timers.csv);
 	}
-	sdtx_draw();
+}
+
+/// Read back the oldest frame of timestamps if the GPU has passed them all,
+/// without waiting for it, and take the timestamp starting this frame
+static void begin_timings() {
+	state.timers.marked = state.show_timings || state.timers.csv;
+#ifdef GPU_TIMERS
+	const int slot = state.timers.slot;
+	uint32_t* queries = state.timers.queries[slot];
+	if (state.timers.pending[slot]) {
+		GLuint available = 0;
+		glGetQueryObjectuiv(queries[NUM_PASSES], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 t[NUM_PASSES + 1];
+			float ms[NUM_PASSES + 1];
+			for (int i = 0; i <= NUM_PASSES; i++) {
+				glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &t[i]);
+			}
+			for (int i = 0; i < NUM_PASSES; i++) {
+				ms[i] = 1e-6 * (t[i + 1] - t[i]);
+			}
+			ms[NUM_PASSES] = state.timers.duration[slot];
+			record_timings(state.timers.frame[slot], ms);
+		} else {
+			// The queries are taken over by this frame
+			state.timers.dropped++;
+		}
+	}
+	if (state.timers.marked) {
+		glQueryCounter(queries[0], GL_TIMESTAMP);
+	}
+	state.timers.pending[slot] = state.timers.marked;
+	state.timers.frame[slot] = sapp_frame_count();
+	state.timers.duration[slot] = 1e3 * sapp_frame_duration();
+#else
+	if (state.timers.marked) {
+		const float ms[NUM_PASSES + 1] = { [NUM_PASSES] = 1e3 * sapp_frame_duration() };
+		record_timings(sapp_frame_count(), ms);
+	}
+#endif
+}
+
+/// Take the timestamp at the end of a pass. The time between the marks
+/// includes the GPU waiting for the CPU to record the next pass.
+static void end_pass_timing(pass_t pass) {
+#ifdef GPU_TIMERS
+	if (state.timers.marked) {
+		glQueryCounter(state.timers.queries[state.timers.slot][pass + 1], GL_TIMESTAMP);
+	}
+#endif
+}
+
+static void end_timings() {
+	state.timers.slot = (state.timers.slot + 1) % TIMER_FRAMES;
+}
+
+static int compare_floats(const void* a, const void* b) {
+	const float x = *(const float*) a, y = *(const float*) b;
+	return (x > y) - (x < y);
+}
+
+/// Print the average and the 99th percentile of the recent timings
+static void print_timings() {
+	const size_t n = state.timers.count < TIMER_HISTORY ? state.timers.count : TIMER_HISTORY;
+	if (n == 0) return;
+	sdtx_printf("%-8s%8s%8s\n", "ms", "avg", "p99");
+	float sorted[TIMER_HISTORY];
+	for (int i = 0; i <= NUM_PASSES; i++) {
+#ifndef GPU_TIMERS
+		if (i < NUM_PASSES) continue;
+#endif
+		float sum = 0;
+		for (size_t j = 0; j < n; j++) {
+			sorted[j] = state.timers.ms[j][i];
+			sum += sorted[j];
+		}
+		qsort(sorted, n, sizeof(*sorted), compare_floats);
+		sdtx_printf("%-8s%8.3f%8.3f\n", i < NUM_PASSES ? PASSES[i] : "frame",
+			    sum / n, sorted[(99*n - 1) / 100]);
+	}
+	sdtx_printf("dropped %zu\n", state.timers.dropped);
 }
 
 static void prepare_dark_rectangle() {
@@ -399,57 +712,564 @@ static void prepare_dark_rectangle() {
 	sgl_end();
 }
 
+/// Recreate the offscreen targets of the fractal with the given size
+static void make_targets(int w, int h) {
+	for (int i = 0; i < 2; i++) {
+		sg_destroy_pass(state.gfx.target_pass[i]);
+		sg_destroy_image(state.gfx.target[i]);
+		state.gfx.target[i] = sg_make_image(&(sg_image_desc){
+			.render_target = true,
+			.width = w > 0 ? w : 1,
+			.height = h > 0 ? h : 1,
+			.pixel_format = SG_PIXELFORMAT_RGBA32SI,
+			.sample_count = 1,
+		});
+		state.gfx.target_pass[i] = sg_make_pass(&(sg_pass_desc){
+			.color_attachments[0].image = state.gfx.target[i],
+		});
+	}
+	if (state.gfx.cache || state.atlas) {
+		sg_destroy_image(state.gfx.cache_image);
+		state.gfx.cache_image = sg_make_image(&(sg_image_desc){
+			.width = w > 0 ? w : 1,
+			.height = h > 0 ? h : 1,
+			.usage = SG_USAGE_STREAM,
+			.pixel_format = SG_PIXELFORMAT_RGBA32SI,
+		});
+		free(state.gfx.texels);
+		state.gfx.texels = malloc(4 * sizeof(int32_t) * (w > 0 ? w : 1) * (h > 0 ? h : 1));
+	}
+}
+
+/// The parameters the fractal depends on, without the ones only used when
+/// displaying it. The selected orbit is drawn over view 1, so choosing
+/// another one does not start the fractal over, and view 0 maps the
+/// parameters from the pixels, so neither does clicking or moving in it.
+static params_t fractal_inputs() {
+	params_t par = state.params;
+	par.color = 0;
+	if (par.view) {
+		par.p = (point_t){ 0, 0 };
+	} else {
+		par.delta = 0;
+		par.epsilon = 0;
+	}
+	return par;
+}
+
+/// Compute the parameters of the offscreen fractal pass and how to map it
+/// on the screen. When view 1 is zoomed in, every texel of the target covers
+/// one cell of the lattice, so the shader runs once per visible lattice point
+/// rather than once per screen pixel.
+static params_t fractal_params(blit_t* blit) {
+	params_t par = fractal_inputs();
+	const point_t res = par.resolution;
+	if (!par.view || par.zoom <= 1.0) {
+		// A smaller target keeps the center of the screen in its center
+		const float s = state.gfx.render_scale;
+		const point_t size = { ceil(s*res.x), ceil(s*res.y) };
+		blit->scale = (point_t){ s/size.x, s/size.y };
+		blit->offset = (point_t){ (size.x - s*res.x)/(2*size.x),
+					  (size.y - s*res.y)/(2*size.y) };
+		par.resolution = size;
+		par.zoom *= s;
+
+		// Move the target less than a texel onto the pixel grid of its zoom,
+		// where the tiles of the cache lie, and move it back on the screen
+		const dpoint_t cam = get_cam();
+		const double x = -cam.x * par.zoom - 0.5 * size.x;
+		const double y = -cam.y * par.zoom - 0.5 * size.y;
+		const double dx = x - round(x), dy = y - round(y);
+		const double cx = cam.x + dx / par.zoom, cy = cam.y + dy / par.zoom;
+		par.cam = (point_t){ cx, cy };
+		par.cam_lo = (point_t){ cx - par.cam.x, cy - par.cam.y };
+		blit->offset.x += dx / size.x;
+		blit->offset.y -= dy / size.y;
+		return par;
+	}
+
+	// The visible lattice cells, the texel (i, j) shows the cell (x0 + i, y1 - j).
+	// The screen spans at most floor(res/z) + 2 cells wherever it is within
+	// them, and a target of that size whatever the pan lets panning move only
+	// its origin, so that the image gets shifted instead of started over.
+	// The cells count in doubles, which the integer kernel takes exactly with cam_lo.
+	const float z = par.zoom;
+	const dpoint_t cam = get_cam();
+	const double left = -res.x/(2*z) - cam.x, top = -res.y/(2*z) - cam.y;
+	const point_t size = { floor(res.x/z) + 2, floor(res.y/z) + 2 };
+	const double x0 = floor(left), y0 = floor(top), y1 = y0 + size.y - 1;
+	blit->scale = (point_t){ 1.0/(z*size.x), 1.0/(z*size.y) };
+	blit->offset = (point_t){ (left - x0)/size.x, (y1 + 1 + top + 2*cam.y)/size.y };
+
+	par.resolution = size;
+	par.zoom = 1.0;
+	const double cx = -size.x/2 - x0, cy = size.y/2 - y1 - 1;
+	par.cam = (point_t){ cx, cy };
+	par.cam_lo = (point_t){ cx - par.cam.x, cy - par.cam.y };
+	return par;
+}
+
+/// Whether every orbit of the target has closed or reached the cap
+static bool fractal_done() {
+	return state.gfx.stride == 0
+		&& (state.gfx.iterated >= state.iters || state.gfx.finished >= state.iters);
+}
+
+/// Adapt the resolution of the fractal to the frame time while the view
+/// changes, and go back to the full resolution once it stays still
+static void update_render_scale() {
+	const params_t par = fractal_inputs();
+	if (memcmp(&par, &state.gfx.last_params, sizeof(params_t))) {
+		state.gfx.idle = 0;
+	} else {
+		state.gfx.idle++;
+	}
+	state.gfx.last_params = par;
+	const double dt = sapp_frame_duration();
+	if (state.gfx.idle > IDLE_FRAMES) {
+		// Once the fractal is done, the frames only wait for vsync,
+		// and the target cannot be shorter than that
+		if (fractal_done()) {
+			state.gfx.min_duration = fmin(dt, 1.001 * state.gfx.min_duration);
+		}
+		state.gfx.render_scale = 1.0;
+		return;
+	}
+
+	const double target = fmax(FRAME_TARGET, state.gfx.min_duration);
+	// The frame duration is averaged, give it time to follow a change
+	state.gfx.settle++;
+	if (dt > 1.25 * target && state.gfx.settle > 4 && state.gfx.scale > MIN_SCALE) {
+		state.gfx.scale--;
+		state.gfx.settle = 0;
+	} else if (dt < 1.05 * target && state.gfx.settle > 30 && state.gfx.scale < 8) {
+		state.gfx.scale++;
+		state.gfx.settle = 0;
+	}
+	state.gfx.render_scale = state.gfx.scale / 8.0;
+}
+
+/// The largest coordinate on the target, like ic_render computes it
+static double magnitude(const params_t par) {
+	return fmax(fabs(par.cam.x), fabs(par.cam.y))
+		+ 0.5 * fmax(par.resolution.x, par.resolution.y) / par.zoom;
+}
+
+/// Whether zooms into the d/e plane go beyond the precision of floats and
+/// take the kernel with pairs of floats for the parameters
+static bool deep_zoom(const params_t par) {
+	return !par.view && ic_deep_zoom(magnitude(par), par.zoom);
+}
+
+/// The kernel that renders the target, numbered like in ic_render: 0 for
+/// floats, 1 for the integer kernel if its fixed point holds the parameters,
+/// and 2 for deep zooms
+static int fractal_kernel(const params_t par) {
+	if (deep_zoom(par)) return 2;
+	const bool fits = par.view
+		? ic_fits_fixed(fmax(fabs(par.delta), fabs(par.epsilon)), magnitude(par))
+		: ic_fits_fixed(magnitude(par), fmax(fabs(par.p.x), fabs(par.p.y)));
+	return state.gfx.int_kernel && fits;
+}
+
+#ifdef GPU_READBACK
+/// Read the state of the orbits in the current target, the rows from the bottom
+static void read_target(int w, int h, int32_t* texels) {
+	// The pass binds the target, keeping its contents
+	sg_begin_pass(state.gfx.target_pass[state.gfx.current], &(sg_pass_action){
+		.colors[0].load_action = SG_LOADACTION_LOAD,
+	});
+	glReadPixels(0, 0, w, h, GL_RGBA_INTEGER, GL_INT, texels);
+	sg_end_pass();
+}
+#endif
+
+/// The key of the tiles of the fractal, with the kernels numbered like in
+/// ic_render, and the pixel of the grid at the top left of the target
+static bool tile_key(const params_t par, ic_tile_key_t* key, int64_t origin[2]) {
+	*key = (ic_tile_key_t){
+		.view = par.view,
+		.kernel = fractal_kernel(par),
+		.delta = par.view ? par.delta : 0,
+		.epsilon = par.view ? par.epsilon : 0,
+		.p = par.view ? (point_t){ 0, 0 } : par.p,
+		.iters = state.iters,
+		.zoom = par.zoom,
+	};
+	const double cx = -(double) par.cam.x - par.cam_lo.x;
+	const double cy = -(double) par.cam.y - par.cam_lo.y;
+	return ic_grid_origin(cx, cy, par.zoom, par.resolution.x, par.resolution.y,
+			      &origin[0], &origin[1]);
+}
+
+/// Put the tiles within the finished target into the cache
+static void store_tiles(const params_t par) {
+	state.gfx.stored = true;
+#ifdef GPU_READBACK
+	ic_tile_key_t key;
+	int64_t origin[2];
+	if (!state.gfx.cache || !tile_key(par, &key, origin)) return;
+	const int w = par.resolution.x, h = par.resolution.y;
+	const int x0 = (IC_CACHE_TILE - (origin[0] & (IC_CACHE_TILE - 1))) & (IC_CACHE_TILE - 1);
+	const int y0 = (IC_CACHE_TILE - (origin[1] & (IC_CACHE_TILE - 1))) & (IC_CACHE_TILE - 1);
+	if (x0 + IC_CACHE_TILE > w || y0 + IC_CACHE_TILE > h) return;
+	read_target(w, h, state.gfx.texels);
+	for (int y = y0; y + IC_CACHE_TILE <= h; y += IC_CACHE_TILE) {
+		for (int x = x0; x + IC_CACHE_TILE <= w; x += IC_CACHE_TILE) {
+			key.x = (origin[0] + x) / IC_CACHE_TILE;
+			key.y = (origin[1] + y) / IC_CACHE_TILE;
+			uint32_t* periods = ic_cache_put(state.gfx.cache, &key);
+			for (int j = 0; j < IC_CACHE_TILE; j++) {
+				// The rows of the target count from the bottom
+				const int32_t* texel = state.gfx.texels + 4 * ((h - 1 - y - j) * w + x);
+				for (int i = 0; i < IC_CACHE_TILE; i++, texel += 4) {
+					periods[j * IC_CACHE_TILE + i] = texel[3] == CLOSED ? texel[2] : 0;
+				}
+			}
+		}
+	}
+#endif
+}
+
+/// Upload the state of the orbits of the target with the tiles found in the
+/// cache or the atlas finished and the rest waiting, and return whether any
+/// were found
+static bool load_tiles(const params_t par) {
+	ic_tile_key_t key;
+	int64_t origin[2];
+	if ((!state.gfx.cache && !state.atlas) || !tile_key(par, &key, origin)) return false;
+	const int w = par.resolution.x, h = par.resolution.y;
+	const int x0 = -(int) (origin[0] & (IC_CACHE_TILE - 1));
+	const int y0 = -(int) (origin[1] & (IC_CACHE_TILE - 1));
+	bool found = false;
+	for (int y = y0; y < h; y += IC_CACHE_TILE) {
+		for (int x = x0; x < w; x += IC_CACHE_TILE) {
+			// The tiles across the edges fill in their part of the target
+			key.x = (origin[0] + x) / IC_CACHE_TILE;
+			key.y = (origin[1] + y) / IC_CACHE_TILE;
+			const uint32_t* periods = NULL;
+			if (state.gfx.cache) {
+				periods = ic_cache_get(state.gfx.cache, &key);
+			}
+			if (!periods && state.atlas) {
+				periods = ic_atlas_get(state.atlas, &key);
+			}
+			found |= periods != NULL;
+			for (int j = y < 0 ? 0 : y; j < y + IC_CACHE_TILE && j < h; j++) {
+				int32_t* texel = state.gfx.texels + 4 * ((h - 1 - j) * w);
+				for (int i = x < 0 ? 0 : x; i < x + IC_CACHE_TILE && i < w; i++) {
+					const uint32_t period = periods
+						? periods[(j - y) * IC_CACHE_TILE + i - x] : 0;
+					texel[4 * i] = texel[4 * i + 1] = 0;
+					// The open orbits stay at the cap without their points
+					texel[4 * i + 2] = period ? period : state.iters;
+					texel[4 * i + 3] = !periods ? WAITING : period ? CLOSED : RUNNING;
+				}
+			}
+		}
+	}
+	if (found) {
+		sg_update_image(state.gfx.cache_image, &(sg_image_data){
+			.subimage[0][0] = { state.gfx.texels, 4 * sizeof(int32_t) * w * h },
+		});
+	}
+	return found;
+}
+
+/// Take the result of the query in flight, and start another one over the
+/// current target once all its pixels started
+static void count_orbits() {
+#ifdef GPU_OCCLUSION
+	const GLuint query = state.gfx.count_query;
+	if (state.gfx.counting) {
+		GLuint available = 0, any = 1;
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT, &any);
+		state.gfx.counting = false;
+		if (!any && state.gfx.counted[0] == state.gfx.generation) {
+			state.gfx.finished = state.gfx.counted[1];
+		}
+	}
+	if (state.gfx.stride || fractal_done()) return;
+
+	// The other target is free until the next frame, nothing is written
+	sg_begin_pass(state.gfx.target_pass[!state.gfx.current], &state.gfx.pass_action);
+	sg_bindings bind = state.gfx.bind;
+	bind.fs.images[0] = state.gfx.target[state.gfx.current];
+	sg_apply_pipeline(state.gfx.count_pip);
+	sg_apply_bindings(&bind);
+	sg_apply_uniforms(SG_SHADERSTAGE_FS, 0, &SG_RANGE(state.iters));
+	glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+	sg_draw(0, 3, 1);
+	glEndQuery(GL_ANY_SAMPLES_PASSED);
+	sg_end_pass();
+	state.gfx.counting = true;
+	state.gfx.counted[0] = state.gfx.generation;
+	state.gfx.counted[1] = state.iters;
+#endif
+}
+
+/// Start the orbits in the offscreen target if the view has changed,
+/// otherwise continue them until they reach the iteration cap.
+/// The first frame only starts every n-th pixel in both directions, with n
+/// up to MAX_STRIDE to keep within the budget, and the next ones fill in
+/// the grids of half the stride.
+static void render_fractal(const params_t par) {
+	const params_t old = state.gfx.target_params;
+	const bool same = state.gfx.target_valid && !memcmp(&par, &old, sizeof(params_t));
+	if (same && fractal_done()) {
+		if (!state.gfx.stored) {
+			store_tiles(par);
+		}
+		return;
+	}
+	if (!state.gfx.target_valid || !eq_pt(par.resolution, old.resolution)) {
+		make_targets((int) par.resolution.x, (int) par.resolution.y);
+		state.gfx.target_valid = false;
+	}
+
+	// With unit zoom in view 1, panning by whole cells only translates
+	// the image. Copy the previous image shifted and compute only the strips
+	// that got exposed, as the rectangles x, y, w, h of the target.
+	const int w = par.resolution.x, h = par.resolution.y;
+	int strips[2][4] = { { 0, 0, w, h }, { 0, 0, 0, 0 } };
+	params_t moved = par;
+	moved.cam = old.cam;
+	moved.cam_lo = old.cam_lo;
+	const double dx = ((double) old.cam.x - par.cam.x) + (old.cam_lo.x - par.cam_lo.x);
+	const double dy = ((double) old.cam.y - par.cam.y) + (old.cam_lo.y - par.cam_lo.y);
+	const bool shift = !same && state.gfx.target_valid && par.view && par.zoom == 1.0
+		&& !memcmp(&moved, &old, sizeof(params_t))
+		&& fractal_kernel(par) == fractal_kernel(old)
+		&& dx == floor(dx) && dy == floor(dy) && fabs(dx) < w && fabs(dy) < h;
+	if (shift) {
+		strips[0][0] = dx > 0 ? w - dx : 0;
+		strips[0][2] = fabs(dx);
+		strips[1][1] = dy > 0 ? 0 : h + dy;
+		strips[1][2] = w;
+		strips[1][3] = fabs(dy);
+	}
+
+	// The orbits start from the tiles in the cache when starting over
+	const bool loaded = !same && !shift && load_tiles(par);
+	const int prev = state.gfx.current;
+	state.gfx.current = !prev;
+	sg_begin_pass(state.gfx.target_pass[state.gfx.current], &state.gfx.pass_action);
+	if (shift) {
+		// The copied orbits carry on in the next frames
+		const blit_t copy = {
+			.scale = { 1.0/w, 1.0/h },
+			.offset = { dx/w, -dy/h },
+		};
+		sg_bindings bind = state.gfx.blit_bind;
+		bind.fs.images[0] = state.gfx.target[prev];
+		// The copy has no palette to bind
+		bind.fs.images[1] = (sg_image){ SG_INVALID_ID };
+		sg_apply_pipeline(state.gfx.copy_pip);
+		sg_apply_bindings(&bind);
+		sg_apply_uniforms(SG_SHADERSTAGE_FS, 0, &SG_RANGE(copy));
+		sg_draw(0, 3, 1);
+	}
+
+	// A band of rows at a stride s has 3/(4s^2) new pixels in average.
+	// The exposed strips start all at once, they are narrow.
+	int stride = MAX_STRIDE, rows[2] = { 0, h };
+	if (shift) {
+		stride = 1;
+		state.gfx.grid[0] = (state.gfx.grid[0] + (int) dx) & (MAX_STRIDE - 1);
+		state.gfx.grid[1] = (state.gfx.grid[1] - (int) dy) & (MAX_STRIDE - 1);
+		// The rows the band has started move up by dy with the image
+		const int row = state.gfx.row + (int) dy;
+		state.gfx.row = row < 0 ? 0 : row > h ? h : row;
+	} else if (!same) {
+		while (stride > 1 && (double) w*h / (stride*stride/4) <= PIXEL_BUDGET) {
+			stride /= 2;
+		}
+		state.gfx.stride = stride/2;
+		state.gfx.row = 0;
+		state.gfx.grid[0] = state.gfx.grid[1] = 0;
+	} else if (state.gfx.stride) {
+		stride = state.gfx.stride;
+		const int band = 2*stride * ceil(2.0*PIXEL_BUDGET*stride / (3.0*w));
+		rows[0] = state.gfx.row;
+		rows[1] = state.gfx.row += band;
+		if (state.gfx.row >= h) {
+			state.gfx.stride /= 2;
+			state.gfx.row = 0;
+		}
+	} else {
+		stride = 1;
+		rows[1] = 0;
+	}
+	const int kernel = fractal_kernel(par);
+	const iterate_t it = {
+		.params = par,
+		.start = !same && !loaded,
+		.iters = state.iters,
+		.stride = stride,
+		.rows = { rows[0], rows[1] },
+		.grid = { state.gfx.grid[0], state.gfx.grid[1] },
+	};
+	state.gfx.bind.fs.images[0] = loaded ? state.gfx.cache_image : state.gfx.target[prev];
+	sg_apply_pipeline(kernel == 2 ? state.gfx.deep_pip
+			  : kernel ? state.gfx.pip[par.view] : state.gfx.float_pip[par.view]);
+	sg_apply_bindings(&state.gfx.bind);
+	sg_apply_uniforms(SG_SHADERSTAGE_FS, 0, &SG_RANGE(it));
+	for (int i = 0; i < 2; i++) {
+		if (strips[i][2] > 0 && strips[i][3] > 0) {
+			sg_apply_scissor_rect(strips[i][0], strips[i][1],
+					      strips[i][2], strips[i][3], false);
+			sg_draw(0, 3, 1);
+		}
+	}
+	sg_end_pass();
+
+	state.gfx.blit_bind.fs.images[0] = state.gfx.target[state.gfx.current];
+	state.gfx.blit.grid[0] = state.gfx.grid[0];
+	state.gfx.blit.grid[1] = state.gfx.grid[1];
+	state.gfx.target_params = par;
+	state.gfx.target_valid = true;
+	state.gfx.stored = false;
+	if (!same && !shift) {
+		state.gfx.cached = loaded;
+	}
+	if (!same) {
+		// The orbits the query counts are gone
+		state.gfx.generation++;
+		state.gfx.finished = 0;
+	}
+	const bool started = rows[1] > rows[0];
+	state.gfx.iterated = started ? ITER_SLICE : state.gfx.iterated + ITER_SLICE;
+	count_orbits();
+}
+
+/// Rebuild the palette if the color scheme or the cap on the iterations
+/// changed. Caps beyond its size share an entry between several counts.
+static void update_palette() {
+	const uint32_t color = state.params.color, iters = state.iters;
+	if (color == state.gfx.palette_color && iters == state.gfx.palette_iters) {
+		return;
+	}
+	state.gfx.palette_color = color;
+	state.gfx.palette_iters = iters;
+	const uint32_t step = ic_palette_step(iters);
+	state.gfx.blit.step = step;
+
+	static uint8_t pixels[IC_PALETTE_SIZE][4];
+	const size_t n = (iters + step - 1) / step;
+	for (size_t k = 0; k < n; k++) {
+		ic_count_color(color, state.palettes, k * step + 1, iters, pixels[k]);
+		pixels[k][3] = 255;
+	}
+	sg_update_image(state.gfx.palette, &(sg_image_data){
+		.subimage[0][0] = SG_RANGE(pixels),
+	});
+}
+
+/// Save the fractal the GPU rendered, colored like on the screen, with the
+/// options that render it on the CPU, which ic_render compare checks
+static void save_fractal() {
+	state.save_fractal = false;
+#ifdef GPU_READBACK
+	if (!state.gfx.target_valid || !fractal_done()) {
+		fprintf(stderr, "The fractal is not done yet\n");
+		return;
+	}
+	const params_t par = state.gfx.target_params;
+	const int w = par.resolution.x, h = par.resolution.y;
+	FILE* f = fopen(SAVE_FILE, "wb");
+	if (!f) {
+		perror(SAVE_FILE);
+		return;
+	}
+	int32_t* texels = malloc(4 * sizeof(int32_t) * w * h);
+	read_target(w, h, texels);
+
+	const char* kernel = (const char*[]){ "float", "fixed", "deep" }[fractal_kernel(par)];
+	fprintf(f, "P6\n# ic_render image -v %u -d %.9g -e %.9g -p %.9g,%.9g -c %.17g,%.17g "
+		"-z %.9g -s %dx%d -n %u -k %s", par.view, par.delta, par.epsilon, par.p.x,
+		par.p.y, -(double) par.cam.x - par.cam_lo.x, -(double) par.cam.y - par.cam_lo.y,
+		par.zoom, w, h, state.iters, kernel);
+	const uint32_t color = state.params.color;
+	if (color < IC_SCHEMES) {
+		fprintf(f, " --color %u\n", color);
+	} else {
+		fprintf(f, " --palette %s --color %d\n", state.palette_files[color - IC_SCHEMES],
+			IC_SCHEMES);
+	}
+	fprintf(f, "%d %d\n255\n", w, h);
+	// The rows of the target count from the bottom
+	for (int j = h - 1; j >= 0; j--) {
+		for (int i = 0; i < w; i++) {
+			uint8_t rgb[3];
+			ic_count_color(color, state.palettes, texels[4 * (j * w + i) + 2],
+				       state.iters, rgb);
+			fwrite(rgb, 1, 3, f);
+		}
+	}
+	fclose(f);
+	free(texels);
+	printf("Saved the fractal into %s\n", SAVE_FILE);
+#endif
+}
+
 static void frame() {
 	// Change the parameter if move is enabled
 	update_parameter(&state.params.epsilon, &state.params.delta, state.move*0.00002);
     
 	const float w = sapp_widthf(), h = sapp_heightf();
 	state.params.resolution = (point_t){ .x = w, .y = h };
+	begin_timings();
+	update_render_scale();
+	render_fractal(fractal_params(&state.gfx.blit));
+	if (state.save_fractal) {
+		save_fractal();
+	}
+	end_pass_timing(PASS_FRACTAL);
+	update_palette();
 	sg_begin_default_pass(&state.gfx.pass_action, (int) w, (int) h);
-	sg_apply_pipeline(state.gfx.pip);
-	sg_apply_bindings(&state.gfx.bind);
-	sg_apply_uniforms(SG_SHADERSTAGE_FS, 0, &SG_RANGE(state.params));
+	sg_apply_pipeline(state.gfx.color_pip);
+	sg_apply_bindings(&state.gfx.blit_bind);
+	sg_apply_uniforms(SG_SHADERSTAGE_FS, 0, &SG_RANGE(state.gfx.blit));
 	sg_draw(0, 3, 1);
+	end_pass_timing(PASS_COLOR);
 
 	// Calculate the points in the new orbit
 	if (state.params_changed) {
 		state.params_changed = false;
 		point_t p;
 		if (state.smooth_change) {
-    			p = state.play_pt;
+    			p = state.synth.p;
 			state.smooth_change = false;
 		} else {
     			p = state.params.p;
 		}
-		point_t orig = state.orbit[0] = p;
-		float r = p.x*p.x + p.y*p.y;
-		state.radius = r > 0 ? r : 1e-12;
-		for (state.orbit_len = 1; state.orbit_len < MAX_ITERS; state.orbit_len++) {
-			p = ic_iter(p, state.params.delta, state.params.epsilon);
-			if (eq_pt(p, orig)) break;
-			state.orbit[state.orbit_len] = p;
-			r = p.x*p.x + p.y*p.y;
-			if (r > state.radius) {
-				state.radius = r;
-			}
-		}
+		const size_t len = ic_orbit(p, state.params.delta, state.params.epsilon,
+					    state.orbit.x, state.orbit.y, MAX_ITERS,
+					    &state.synth.radius);
 
-		// Calculate the spectrum in the orbit using FFT
-		state.radius = sqrt(state.radius);
-		const float scale = 1.0/state.radius;
-		for (size_t i = 0; i < state.orbit_len; i++) {
-			point_t q = state.orbit[i];
-			state.spectrum[i] = scale*(q.x + I*q.y);
+		// Calculate the normalized spectrum in the orbit using FFT
+		if (!state.fft || len != state.orbit_len) {
+			fft_plan_destroy(state.fft);
+			state.fft = fft_plan_create(len, false);
 		}
-		fft_transform(state.spectrum, state.orbit_len, false);
-		for (size_t i = 0; i < state.orbit_len; i++) {
-    			state.spectrum[i] /= (float) state.orbit_len;
+		state.orbit_len = len;
+		if (state.fft) {
+			const float scale = 1.0/(state.synth.radius * len);
+			fft_plan_execute_split(state.fft, state.orbit.x, state.orbit.y,
+					       scale, state.spectrum);
+			find_peaks();
+		} else {
+			// Out of memory for the plan, the orbit stays silent
+			state.num_peaks = 0;
 		}
 
-		state.start_volume = 0.4;
+		state.synth.start_volume = 0.4;
 	}
 
-	// Draw the orbit
+	// Draw the orbit over the cells it visits, which stay at least
+	// a pixel wide when zoomed out
 	if (state.params.view) {
 		sgl_layer(0);
 		sgl_c3f(1.0, 0.0, 0.0);
@@ -458,104 +1278,111 @@ static void frame() {
 		sgl_ortho(-w/2.0, w/2.0, h/2.0, -h/2.0, -1.0, 1.0);
 		sgl_scale(state.params.zoom, state.params.zoom, 1.0);
 		sgl_translate(state.params.cam.x, state.params.cam.y, 0.0);
+		const float size = fmax(1.0, 1.0/state.params.zoom);
+		const float margin = 0.5*(size - 1.0);
+		sgl_begin_quads();
+		for (size_t i = 0; i < state.orbit_len; i++) {
+			const float x = state.orbit.x[i] - margin, y = state.orbit.y[i] - margin;
+			sgl_v2f(x, y); sgl_v2f(x + size, y);
+			sgl_v2f(x + size, y + size); sgl_v2f(x, y + size);
+		}
+		sgl_end();
+
 		sgl_begin_line_strip();
 
 		for (size_t i = 0; i < state.orbit_len; i++) {
-			point_t q = state.orbit[i];
-			sgl_v2f(q.x + 0.5, q.y + 0.5);
+			sgl_v2f(state.orbit.x[i] + 0.5, state.orbit.y[i] + 0.5);
 		}
-		sgl_v2f(state.orbit[0].x + 0.5, state.orbit[0].y + 0.5);
+		sgl_v2f(state.orbit.x[0] + 0.5, state.orbit.y[0] + 0.5);
 		sgl_end();
 	}
 	
 	sgl_layer(1);
 	prepare_dark_rectangle();
 	sgl_draw_layer(0);
+	end_pass_timing(PASS_ORBIT);
 	
 	sdtx_canvas(sapp_width()/2.0f, sapp_height()/2.0f);
 	sdtx_color3b(255, 255, 255);
 	sdtx_origin(3.0, 3.0);
 	sdtx_home();
-	if (state.show_help) {
+	if (state.show_help || state.show_info || state.show_timings) {
 		sgl_draw_layer(1);
+	}
+	if (state.show_help) {
 		sdtx_puts(HELP);
-		sdtx_draw();
 	} else if (state.show_info) {
-		sgl_draw_layer(1);
 		print_info();
 	}
+	if (state.show_timings) {
+		// In the bottom left corner, in characters of 8 pixels
+		sdtx_pos(0, sapp_height()/16.0f - 7.0f - NUM_PASSES);
+		print_timings();
+	}
+	sdtx_draw();
+	end_pass_timing(PASS_TEXT);
 	
 	sg_end_pass();
 	sg_commit();
+	end_timings();
 
 	// Generate the audio samples
-	size_t nsamples = saudio_expect();
-	const size_t steps = saudio_sample_rate() / (float) MAX_FREQ;
-	nsamples = steps * (nsamples / steps);
-
-	const float scale = 1.0/state.radius;
-	point_t p = scale_pt(state.play_pt, scale), prev = p;
-	const float old_scale = 1.0/state.radius;
-	point_t op = scale_pt(state.old.p, old_scale), oprev = op;
-	for (size_t i = 0; i < nsamples; i++) {
-		if (i % steps == 0) {
-			prev = p;
-			state.play_pt = ic_iter(state.play_pt, state.params.delta,
-						state.params.epsilon);
-			p = scale_pt(state.play_pt, scale);
-			
-			oprev = op;
-			state.old.p = ic_iter(state.old.p, state.params.delta,
-					      state.params.epsilon);
-			op = scale_pt(state.old.p, old_scale);
-		}
-
-		if (state.dampen) {
-			state.volume *= 0.99995;
-		}
-		if (state.start_volume < 1.0) {
-    			state.start_volume *= 1.02;
-		}
-		state.old.volume *= 0.999;
-		const float v = state.volume * state.start_volume;
-		const float ov = state.old.volume;
-		
-		// Cosine interpolation
-		float t = (float) (i % steps) / (float) steps;
-		t = 0.5 - 0.5*cos(M_PI*t);
-		state.audio_buffer[2*i] = v*((1 - t)*prev.x + t*p.x);
-		state.audio_buffer[2*i] += ov*((1 - t)*oprev.x + t*op.x);
-		state.audio_buffer[2*i + 1] = v*((1 - t)*prev.y + t*p.y);
-		state.audio_buffer[2*i + 1] += ov*((1 - t)*oprev.y + t*op.y);
-	}
+	const size_t steps = saudio_sample_rate() / (float) IC_MAX_FREQ;
+	const size_t nsamples = steps * (saudio_expect() / steps);
+	ic_synthesize(&state.synth, state.params.delta, state.params.epsilon, steps,
+		      state.audio_buffer, nsamples);
 	if (nsamples > 0) {
 		saudio_push(state.audio_buffer, nsamples);
 	}
 }
 
-static char* read_to_string(char* filename) {
-	FILE *f = fopen(filename, "rb");
-	if (!f) {
-		fprintf(stderr, "Error: can't read %s", filename);
-	}
-	fseek(f, 0, SEEK_END);
-	const size_t len = ftell(f);
-	fseek(f, 0, SEEK_SET);
-	char *buffer = malloc(len + 1);
-	fread(buffer, 1, len, f);
-	buffer[len] = 0;
-	fclose(f);
-	return buffer;
+/// Make the variant of a fragment shader compiled with the given defines
+static sg_shader make_variant(sg_shader_desc desc, const char* src,
+			      const char* defines) {
+	const size_t len = strlen(defines) + strlen(src) + 32;
+	char *buffer = malloc(len);
+	snprintf(buffer, len, "#version 300 es\n%s\n%s", defines, src);
+	desc.fs.source = buffer;
+	const sg_shader shd = sg_make_shader(&desc);
+	free(buffer);
+	return shd;
 }
 
-static void init() {
-	const char *fs_src = read_to_string("frag.glsl");
+/// Make the variants of the fractal kernel for both views
+static bool make_fractal_variants(const sg_shader_desc* desc, const char* src,
+				  sg_shader shd[2]) {
+	bool valid = true;
+	for (int view = 0; view < 2; view++) {
+		char defines[64];
+		snprintf(defines, sizeof(defines),
+			 "#define VIEW %d\n#define SLICE %d\n#define MAX_STRIDE %d",
+			 view, ITER_SLICE, MAX_STRIDE);
+		shd[view] = make_variant(*desc, src, defines);
+		valid &= sg_query_shader_state(shd[view]) == SG_RESOURCESTATE_VALID;
+	}
+	return valid;
+}
 
+/// Make the pipeline of a fractal kernel, which renders into the state
+static sg_pipeline make_fractal_pipeline(sg_shader shd) {
+	return sg_make_pipeline(&(sg_pipeline_desc){
+		.shader = shd,
+		.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT2,
+		.colors[0].pixel_format = SG_PIXELFORMAT_RGBA32SI,
+		.depth.pixel_format = SG_PIXELFORMAT_NONE,
+		.sample_count = 1,
+	});
+}
+
+static void init() {
 	sg_setup(&(sg_desc){
 		.context = sapp_sgcontext(),
 		.logger.func = slog_func,
 	});
 	sgl_setup(&(sgl_desc_t){
+		// The cells of the longest orbit, 6 vertices a quad, its line and
+		// the dark rectangle. Past the budget sokol-gl draws nothing at all.
+		.max_vertices = 7*MAX_ITERS + 64,
 		.logger.func = slog_func,
 	});
 	sdtx_setup(&(sdtx_desc_t){
@@ -563,6 +1390,10 @@ static void init() {
 		.logger.func = slog_func
 	});
 
+#ifdef GPU_TIMERS
+	glGenQueries(TIMER_FRAMES * (NUM_PASSES + 1), &state.timers.queries[0][0]);
+#endif
+
 	state.gfx.pass_action = (sg_pass_action) {
 		.colors[0] = { .load_action = SG_LOADACTION_DONTCARE }
 	};
@@ -572,30 +1403,160 @@ static void init() {
 	state.gfx.bind.vertex_buffers[0] = sg_make_buffer(&(sg_buffer_desc){
 		.data = SG_RANGE(verts)
 	});
-	state.gfx.pip = sg_make_pipeline(&(sg_pipeline_desc){
-		.shader = sg_make_shader(&(sg_shader_desc){
-			.attrs[0] = { .name="pos", .sem_name="POSITION" },
-			.vs.source = VERTEX_SHADER,
-			.fs.source = fs_src,
-			.fs.uniform_blocks[0].size = sizeof(params_t),
-			.fs.uniform_blocks[0].uniforms = {
-				[0] = { .name = "iRes", .type = SG_UNIFORMTYPE_FLOAT2 },
-				[1] = { .name = "iCam", .type = SG_UNIFORMTYPE_FLOAT2 },
-				[2] = { .name = "iZoom", .type = SG_UNIFORMTYPE_FLOAT },
-				[3] = { .name = "iDelta", .type = SG_UNIFORMTYPE_FLOAT },
-				[4] = { .name = "iEpsilon", .type = SG_UNIFORMTYPE_FLOAT },
-				[5] = { .name = "iPoint", .type = SG_UNIFORMTYPE_FLOAT2 },
-				[6] = { .name = "iView", .type = SG_UNIFORMTYPE_INT },
-				[7] = { .name = "iColor", .type = SG_UNIFORMTYPE_INT },
-			},
-		}),
+	sg_shader_desc fractal_desc = {
+		.attrs[0] = { .name="pos", .sem_name="POSITION" },
+		.vs.source = VERTEX_SHADER,
+		.fs.uniform_blocks[0].size = sizeof(iterate_t),
+		.fs.uniform_blocks[0].uniforms = {
+			[0] = { .name = "iRes", .type = SG_UNIFORMTYPE_FLOAT2 },
+			[1] = { .name = "iCam", .type = SG_UNIFORMTYPE_FLOAT2 },
+			[2] = { .name = "iCamLo", .type = SG_UNIFORMTYPE_FLOAT2 },
+			[3] = { .name = "iZoom", .type = SG_UNIFORMTYPE_FLOAT },
+			[4] = { .name = "iDelta", .type = SG_UNIFORMTYPE_FLOAT },
+			[5] = { .name = "iEpsilon", .type = SG_UNIFORMTYPE_FLOAT },
+			[6] = { .name = "iPoint", .type = SG_UNIFORMTYPE_FLOAT2 },
+			// Compiled into the variants, kept for the layout of params_t
+			[7] = { .name = "iView", .type = SG_UNIFORMTYPE_INT },
+			[8] = { .name = "iColor", .type = SG_UNIFORMTYPE_INT },
+			[9] = { .name = "iStart", .type = SG_UNIFORMTYPE_INT },
+			[10] = { .name = "iIters", .type = SG_UNIFORMTYPE_INT },
+			[11] = { .name = "iStride", .type = SG_UNIFORMTYPE_INT },
+			[12] = { .name = "iRows", .type = SG_UNIFORMTYPE_INT2 },
+			[13] = { .name = "iGrid", .type = SG_UNIFORMTYPE_INT2 },
+		},
+		.fs.images[0] = { .used = true, .sample_type = SG_IMAGESAMPLETYPE_SINT },
+		.fs.samplers[0] = { .used = true, .sampler_type = SG_SAMPLERTYPE_SAMPLE },
+		.fs.image_sampler_pairs[0] = {
+			.used = true,
+			.image_slot = 0,
+			.sampler_slot = 0,
+			.glsl_name = "state",
+		},
+	};
+
+	// The integer kernel is exact far from the origin, where the floats
+	// of the other one run out of precision. It needs 32-bit integers
+	// in fragment shaders, so fall back if it does not compile. The float
+	// kernel also takes the parameters beyond the fixed point.
+	sg_shader fractal[2];
+	make_fractal_variants(&fractal_desc, FRAG_GLSL, fractal);
+	for (int view = 0; view < 2; view++) {
+		state.gfx.pip[view] = state.gfx.float_pip[view] = make_fractal_pipeline(fractal[view]);
+	}
+	const sg_backend backend = sg_query_backend();
+	const bool int_kernel = backend == SG_BACKEND_GLCORE33 || backend == SG_BACKEND_GLES3;
+	state.gfx.int_kernel = int_kernel
+		&& make_fractal_variants(&fractal_desc, FRAG_INT_GLSL, fractal);
+	if (state.gfx.int_kernel) {
+		for (int view = 0; view < 2; view++) {
+			state.gfx.pip[view] = make_fractal_pipeline(fractal[view]);
+		}
+	} else if (int_kernel) {
+		sg_destroy_shader(fractal[0]);
+		sg_destroy_shader(fractal[1]);
+	}
+	// The deep kernel only renders the d/e plane
+	char deep_defines[64];
+	snprintf(deep_defines, sizeof(deep_defines), "#define SLICE %d\n#define MAX_STRIDE %d",
+		 ITER_SLICE, MAX_STRIDE);
+	state.gfx.deep_pip = make_fractal_pipeline(make_variant(fractal_desc, FRAG_DEEP_GLSL,
+								 deep_defines));
+
+	// Coloring of the iteration counts on the screen, and a plain copy
+	// of the state between the offscreen targets
+	state.gfx.palette = sg_make_image(&(sg_image_desc){
+		.width = PALETTE_WIDTH,
+		.height = IC_PALETTE_SIZE / PALETTE_WIDTH,
+		.usage = SG_USAGE_DYNAMIC,
+		.pixel_format = SG_PIXELFORMAT_RGBA8,
+	});
+	state.gfx.palette_iters = 0;
+	state.gfx.blit_bind.fs.images[1] = state.gfx.palette;
+	state.gfx.blit_bind.vertex_buffers[0] = state.gfx.bind.vertex_buffers[0];
+	state.gfx.blit_bind.fs.samplers[0] = sg_make_sampler(&(sg_sampler_desc){
+		.min_filter = SG_FILTER_NEAREST,
+		.mag_filter = SG_FILTER_NEAREST,
+		.wrap_u = SG_WRAP_CLAMP_TO_EDGE,
+		.wrap_v = SG_WRAP_CLAMP_TO_EDGE,
+	});
+	state.gfx.bind.fs.samplers[0] = state.gfx.blit_bind.fs.samplers[0];
+#ifdef GPU_READBACK
+	state.gfx.cache = ic_cache_create(state.cache_mb << 20);
+#endif
+	sg_shader_desc blit_desc = {
+		.attrs[0] = { .name="pos", .sem_name="POSITION" },
+		.vs.source = VERTEX_SHADER,
+		.fs.source = COPY_SHADER,
+		.fs.uniform_blocks[0].size = sizeof(blit_t),
+		.fs.uniform_blocks[0].uniforms = {
+			[0] = { .name = "iScale", .type = SG_UNIFORMTYPE_FLOAT2 },
+			[1] = { .name = "iOffset", .type = SG_UNIFORMTYPE_FLOAT2 },
+			[2] = { .name = "iStep", .type = SG_UNIFORMTYPE_INT },
+			[3] = { .name = "iGrid", .type = SG_UNIFORMTYPE_INT2 },
+		},
+		.fs.images[0] = { .used = true, .sample_type = SG_IMAGESAMPLETYPE_SINT },
+		.fs.images[1] = { .used = true, .sample_type = SG_IMAGESAMPLETYPE_FLOAT },
+		.fs.samplers[0] = { .used = true, .sampler_type = SG_SAMPLERTYPE_SAMPLE },
+		.fs.image_sampler_pairs[0] = {
+			.used = true,
+			.image_slot = 0,
+			.sampler_slot = 0,
+			.glsl_name = "periods",
+		},
+		.fs.image_sampler_pairs[1] = {
+			.used = true,
+			.image_slot = 1,
+			.sampler_slot = 0,
+			.glsl_name = "palette",
+		},
+	};
+	char color_defines[64];
+	snprintf(color_defines, sizeof(color_defines),
+		 "#define MAX_STRIDE %d\n#define PALETTE_WIDTH %d", MAX_STRIDE, PALETTE_WIDTH);
+	state.gfx.color_pip = sg_make_pipeline(&(sg_pipeline_desc){
+		.shader = make_variant(blit_desc, COLOR_GLSL, color_defines),
 		.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT2,
-		.colors[0].blend = {
-			.enabled = true,
-			.src_factor_rgb = SG_BLENDFACTOR_SRC_ALPHA,
-			.dst_factor_rgb = SG_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+	});
+	// The copy reads the periods only
+	sg_shader_desc copy_desc = blit_desc;
+	copy_desc.fs.images[1] = (sg_shader_image_desc){ 0 };
+	copy_desc.fs.image_sampler_pairs[1] = (sg_shader_image_sampler_pair_desc){ 0 };
+	state.gfx.copy_pip = sg_make_pipeline(&(sg_pipeline_desc){
+		.shader = sg_make_shader(&copy_desc),
+		.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT2,
+		.colors[0].pixel_format = SG_PIXELFORMAT_RGBA32SI,
+		.depth.pixel_format = SG_PIXELFORMAT_NONE,
+		.sample_count = 1,
+	});
+#ifdef GPU_OCCLUSION
+	// The count of the orbits left only passes the query
+	sg_shader_desc count_desc = {
+		.attrs[0] = { .name="pos", .sem_name="POSITION" },
+		.vs.source = VERTEX_SHADER,
+		.fs.source = COUNT_SHADER,
+		.fs.uniform_blocks[0].size = sizeof(uint32_t),
+		.fs.uniform_blocks[0].uniforms[0] = { .name = "iIters", .type = SG_UNIFORMTYPE_INT },
+		.fs.images[0] = { .used = true, .sample_type = SG_IMAGESAMPLETYPE_SINT },
+		.fs.samplers[0] = { .used = true, .sampler_type = SG_SAMPLERTYPE_SAMPLE },
+		.fs.image_sampler_pairs[0] = {
+			.used = true,
+			.image_slot = 0,
+			.sampler_slot = 0,
+			.glsl_name = "state",
 		},
+	};
+	state.gfx.count_pip = sg_make_pipeline(&(sg_pipeline_desc){
+		.shader = sg_make_shader(&count_desc),
+		.layout.attrs[0].format = SG_VERTEXFORMAT_FLOAT2,
+		.colors[0] = {
+			.pixel_format = SG_PIXELFORMAT_RGBA32SI,
+			.write_mask = SG_COLORMASK_NONE,
+		},
+		.depth.pixel_format = SG_PIXELFORMAT_NONE,
+		.sample_count = 1,
 	});
+	glGenQueries(1, &state.gfx.count_query);
+#endif
 
 	// A sokol-gl pipeline with alpha blending enabled
 	state.gfx.sgl_alpha_pip = sgl_make_pipeline(&(sg_pipeline_desc){
@@ -608,7 +1569,7 @@ static void init() {
 	});
 
 	saudio_setup(&(saudio_desc){
-	    .sample_rate = 48000,
+	    .sample_rate = IC_SAMPLE_RATE,
 	    .num_channels = 2,
 	    .buffer_frames = 1024,
 	    .logger.func = slog_func,
@@ -616,13 +1577,62 @@ static void init() {
 }    
 
 static void cleanup() {
+	if (state.timers.csv) {
+		fclose(state.timers.csv);
+	}
+	fft_plan_destroy(state.fft);
+	ic_cache_destroy(state.gfx.cache);
+	ic_atlas_close(state.atlas);
+	free(state.gfx.texels);
+	for (size_t i = 0; i < state.num_palettes; i++) {
+		free(state.palettes[i].colors);
+	}
 	sdtx_shutdown();
 	sgl_shutdown();
 	sg_shutdown();
 	saudio_shutdown();
 }
 
-sapp_desc sokol_main(int _argc, char* _argv[]) {
+sapp_desc sokol_main(int argc, char* argv[]) {
+	const char* atlas = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--timings") && i + 1 < argc) {
+			// The timings of every frame, in milliseconds
+			state.timers.csv = fopen(argv[++i], "w");
+			if (!state.timers.csv) {
+				perror(argv[i]);
+				exit(1);
+			}
+			fprintf(state.timers.csv, "frame");
+			for (int p = 0; p < NUM_PASSES; p++) {
+				fprintf(state.timers.csv, ",%s", PASSES[p]);
+			}
+			fprintf(state.timers.csv, ",frame_duration\n");
+		} else if (!strcmp(argv[i], "--palette") && i + 1 < argc
+			   && state.num_palettes < sizeof(state.palettes) / sizeof(*state.palettes)) {
+			// Another color scheme for C to cycle through
+			state.palette_files[state.num_palettes] = argv[++i];
+			if (!ic_load_palette(argv[i], &state.palettes[state.num_palettes++])) {
+				fprintf(stderr, "%s: cannot load the palette\n", argv[i]);
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "--cache") && i + 1 < argc) {
+			// Memory for the finished tiles, in megabytes
+			state.cache_mb = atol(argv[++i]);
+		} else if (!strcmp(argv[i], "--atlas") && i + 1 < argc) {
+			atlas = argv[++i];
+		} else {
+			fprintf(stderr, "Usage: %s [--timings FILE] [--palette FILE]... [--cache MB]\n"
+				"       [--atlas FILE]\n", argv[0]);
+			exit(1);
+		}
+	}
+	// Mapped, the atlas takes no time to load
+	state.atlas = ic_atlas_open(atlas ? atlas : ATLAS_FILE);
+	if (atlas && !state.atlas) {
+		fprintf(stderr, "%s: not an atlas\n", atlas);
+		exit(1);
+	}
 	return (sapp_desc) {
 		.init_cb = init,
 		.frame_cb = frame,
@@ -0,0 +1,355 @@
+#ifndef INTEGER_CIRCLE_H
+#define INTEGER_CIRCLE_H
+// The integer circle algorithm, shared by the explorer and the tools
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	float x;
+	float y;
+} point_t;
+
+/// A point of the integer kernel of the explorer
+typedef struct {
+	int32_t x;
+	int32_t y;
+} ipoint_t;
+
+/// Fractional bits of the parameters of the integer kernel
+#define IC_FRAC_BITS 24
+
+/// Bound on the magnitude of the parameters in that fixed point
+#define IC_FIXED_LIMIT (1 << (31 - IC_FRAC_BITS))
+
+/// Ratios of the musical notes in just intonation
+extern const float NOTES[10];
+
+/// One iteration of the integer circle algorithm
+point_t ic_iter(point_t p, const float delta, const float epsilon);
+
+/// One iteration with the parameters in double precision, for zooms into
+/// the d/e plane deeper than floats can resolve
+point_t ic_iter_deep(point_t p, const double delta, const double epsilon);
+
+/// A parameter in the fixed point of the integer kernel, rounded to the
+/// nearest like the shader does. Its magnitude must be below IC_FIXED_LIMIT.
+int32_t ic_fixed(float x);
+
+/// Whether the integer kernel holds parameters up to the magnitude params
+/// in its fixed point and starting points up to the magnitude points in its
+/// 32-bit integers. The explorer and ic_render take floats otherwise.
+bool ic_fits_fixed(double params, double points);
+
+/// One iteration of the integer kernel, with the parameters in fixed point.
+/// The products are floored from 64 bits and the coordinates wrap around
+/// like 32-bit integers.
+ipoint_t ic_iter_fixed(ipoint_t p, const int32_t delta, const int32_t epsilon);
+
+/// Whether the d/e plane at the given zoom, in pixels per unit, needs the
+/// parameters in double precision for parameters up to the given magnitude
+bool ic_deep_zoom(double magnitude, double zoom);
+
+/// Calculate the period of oscillation if no flooring was done
+float calculate_period(float delta, float epsilon);
+
+/// Update the parameters to keep the period constant
+void update_parameter(float* delta, float* epsilon, float change);
+
+/// Calculate the second parameter with the given period
+float other_parameter(float period, float delta);
+
+/// Store the coordinates of the orbit of p into xs and ys and return
+/// its length, or max_len if the orbit does not close in time.
+/// The largest distance from the origin is stored into radius.
+size_t ic_orbit(point_t p, const float delta, const float epsilon,
+		float* xs, float* ys, size_t max_len, float* radius);
+
+/// Samples per second of the audio
+#define IC_SAMPLE_RATE 48000
+
+/// Steps of the orbits per second in the audio
+#define IC_MAX_FREQ 3200
+
+/// The audio of the orbits. The coordinates of the playing point, scaled
+/// by the radius of its orbit, are the left and right channels as it steps
+/// along the orbit. The point played before fades out.
+typedef struct {
+	point_t p; // playing point
+	point_t old_p; // point played before
+	float radius; // of the orbit of p
+	float volume;
+	float start_volume; // rises back to 1 after the orbit changes
+	float old_volume; // of old_p
+	bool dampen; // let the volume decay
+} ic_synth_t;
+
+/// Synthesize n stereo samples, interleaved into out, stepping the points
+/// along their orbits every steps samples. n is a multiple of steps.
+void ic_synthesize(ic_synth_t* synth, const float delta, const float epsilon,
+		   size_t steps, float* out, size_t n);
+
+/// The number of built-in color schemes
+#define IC_SCHEMES 2
+
+/// Entries of the palettes of the explorer, caps on the iterations beyond
+/// it share an entry between several counts
+#define IC_PALETTE_SIZE 65536
+
+/// A color scheme of colors spread over the iterations on a log scale
+typedef struct {
+	float (*colors)[3];
+	size_t len;
+} ic_palette_t;
+
+/// The RGB color, from 0 to 1, of the orbits that closed in i + 1
+/// iterations or were still open after them, out of the cap of iters,
+/// in a built-in color scheme
+void ic_color(uint32_t scheme, uint32_t i, uint32_t iters, float rgb[3]);
+
+/// The same in a loaded palette
+void ic_palette_color(const ic_palette_t* palette, uint32_t i, uint32_t iters,
+		      float rgb[3]);
+
+/// Iterations per entry of the palette for the cap of iters
+uint32_t ic_palette_step(uint32_t iters);
+
+/// The 8-bit color of the orbits that closed in n iterations or were still
+/// open after them, as the palette of the explorer shows them. The schemes
+/// from IC_SCHEMES on are the loaded palettes.
+void ic_count_color(uint32_t scheme, const ic_palette_t* palettes, uint32_t n,
+		    uint32_t iters, uint8_t rgb[3]);
+
+/// Load the palette from a text file with a color per line, as its red,
+/// green and blue from 0 to 255. Other lines are skipped, so GIMP palettes
+/// load too. Return false if there are no colors, if a color is out of
+/// range, which gets reported, or if they do not fit in memory.
+bool ic_load_palette(const char* path, ic_palette_t* palette);
+
+#endif // INTEGER_CIRCLE_H
+
+#if defined(INTEGER_CIRCLE_IMPLEMENTATION) && !defined(INTEGER_CIRCLE_IMPL_INCLUDED)
+#define INTEGER_CIRCLE_IMPL_INCLUDED
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+
+// Zoom times the magnitude of the parameters from which a step of their
+// floats, 2^-23 times the magnitude, is larger than half a pixel
+#define IC_DEEP_ZOOM (1 << 22)
+
+const float NOTES[10] = { 4.0/6.0, 3.0/4.0, 8.0/10.0, 5.0/6.0, 9.0/10.0,
+                           1.0, 9.0/8.0, 6.0/5.0, 5.0/4.0, 4.0/3.0};
+
+point_t ic_iter(point_t p, const float delta, const float epsilon) {
+	p.x -= floor(delta * p.y);
+	p.y += floor(epsilon * p.x);
+	p.x -= floor(delta * p.y);
+	return p;
+}
+
+point_t ic_iter_deep(point_t p, const double delta, const double epsilon) {
+	p.x -= floor(delta * p.y);
+	p.y += floor(epsilon * p.x);
+	p.x -= floor(delta * p.y);
+	return p;
+}
+
+int32_t ic_fixed(float x) {
+	return nearbyintf(x * (float) (1 << IC_FRAC_BITS));
+}
+
+static inline int32_t ic_mul_fixed(int32_t a, int32_t b) {
+	return (uint32_t) (((int64_t) a * b) >> IC_FRAC_BITS);
+}
+
+ipoint_t ic_iter_fixed(ipoint_t p, const int32_t delta, const int32_t epsilon) {
+	p.x = (uint32_t) p.x - (uint32_t) ic_mul_fixed(delta, p.y);
+	p.y = (uint32_t) p.y + (uint32_t) ic_mul_fixed(epsilon, p.x);
+	p.x = (uint32_t) p.x - (uint32_t) ic_mul_fixed(delta, p.y);
+	return p;
+}
+
+bool ic_fits_fixed(double params, double points) {
+	// Away from deep zooms, the parameters of the pixels stay a fraction
+	// of a pixel within their magnitude, more than floats round them by
+	return params < IC_FIXED_LIMIT && points < INT32_MAX;
+}
+
+bool ic_deep_zoom(double magnitude, double zoom) {
+	// Near 0, the fixed point of the integer kernel resolves as much
+	// as floats do near 1
+	return zoom * fmax(magnitude, 1.0) > IC_DEEP_ZOOM;
+}
+
+float calculate_period(float delta, float epsilon) {
+    return M_PI / asin(sqrt(delta*epsilon/2));
+}
+
+void update_parameter(float* delta, float* epsilon, float change) {
+    const float product = *delta * *epsilon;
+    *delta += change;
+    *epsilon = product / *delta;
+}
+
+float other_parameter(float period, float delta) {
+    const float s = sin(M_PI / period);
+    return 2*s*s/delta;
+}
+
+size_t ic_orbit(point_t p, const float delta, const float epsilon,
+		float* xs, float* ys, size_t max_len, float* radius) {
+	const point_t orig = p;
+	xs[0] = p.x;
+	ys[0] = p.y;
+	float r = p.x*p.x + p.y*p.y;
+	float max_r = r > 0 ? r : 1e-12;
+	size_t len;
+	for (len = 1; len < max_len; len++) {
+		p = ic_iter(p, delta, epsilon);
+		if (p.x == orig.x && p.y == orig.y) break;
+		xs[len] = p.x;
+		ys[len] = p.y;
+		r = p.x*p.x + p.y*p.y;
+		if (r > max_r) {
+			max_r = r;
+		}
+	}
+	*radius = sqrt(max_r);
+	return len;
+}
+
+void ic_synthesize(ic_synth_t* synth, const float delta, const float epsilon,
+		   size_t steps, float* out, size_t n) {
+	const float scale = 1.0/synth->radius;
+	point_t p = { scale*synth->p.x, scale*synth->p.y }, prev = p;
+	point_t op = { scale*synth->old_p.x, scale*synth->old_p.y }, oprev = op;
+	for (size_t i = 0; i < n; i++) {
+		if (i % steps == 0) {
+			prev = p;
+			synth->p = ic_iter(synth->p, delta, epsilon);
+			p = (point_t){ scale*synth->p.x, scale*synth->p.y };
+
+			oprev = op;
+			synth->old_p = ic_iter(synth->old_p, delta, epsilon);
+			op = (point_t){ scale*synth->old_p.x, scale*synth->old_p.y };
+		}
+
+		if (synth->dampen) {
+			synth->volume *= 0.99995;
+		}
+		if (synth->start_volume < 1.0) {
+			synth->start_volume *= 1.02;
+		}
+		synth->old_volume *= 0.999;
+		const float v = synth->volume * synth->start_volume;
+		const float ov = synth->old_volume;
+
+		// Cosine interpolation
+		float t = (float) (i % steps) / (float) steps;
+		t = 0.5 - 0.5*cos(M_PI*t);
+		out[2*i] = v*((1 - t)*prev.x + t*p.x);
+		out[2*i] += ov*((1 - t)*oprev.x + t*op.x);
+		out[2*i + 1] = v*((1 - t)*prev.y + t*p.y);
+		out[2*i + 1] += ov*((1 - t)*oprev.y + t*op.y);
+	}
+}
+
+void ic_color(uint32_t scheme, uint32_t i, uint32_t iters, float rgb[3]) {
+	if (scheme == 1) {
+		// Colors in the YCoCg space
+		const float y = pow(1.0 - (float) i/iters, 1.5);
+		const float co = sin(i * 0.1) * fmin(y, 1.0 - y)/sqrt(2.0);
+		const float cg = cos(i * 0.1) * fmin(y, 1.0 - y)/sqrt(2.0);
+		const float tmp = y - cg;
+		rgb[0] = tmp + co;
+		rgb[1] = y + cg;
+		rgb[2] = tmp - co;
+	} else {
+		const float l = log(i)/log(iters);
+		const float scale = 1.0 - (float) i/iters;
+		rgb[0] = scale*(sin(i * 0.1) * 0.5 + 0.5);
+		rgb[1] = scale*(cos(i * 0.1) * 0.5 + 0.5);
+		rgb[2] = scale*(1.0 - 2.0*l + 2.0*l*l);
+	}
+	for (int c = 0; c < 3; c++) {
+		rgb[c] = fmin(fmax(rgb[c], 0.0), 1.0);
+	}
+}
+
+void ic_palette_color(const ic_palette_t* palette, uint32_t i, uint32_t iters,
+		      float rgb[3]) {
+	const float t = (palette->len - 1) * log1p(i) / log1p(iters);
+	const size_t j = t;
+	const float f = t - j;
+	const float* a = palette->colors[j];
+	const float* b = palette->colors[j + 1 < palette->len ? j + 1 : j];
+	for (int c = 0; c < 3; c++) {
+		rgb[c] = (1 - f)*a[c] + f*b[c];
+	}
+}
+
+uint32_t ic_palette_step(uint32_t iters) {
+	return (iters + IC_PALETTE_SIZE - 1) / IC_PALETTE_SIZE;
+}
+
+void ic_count_color(uint32_t scheme, const ic_palette_t* palettes, uint32_t n,
+		    uint32_t iters, uint8_t rgb[3]) {
+	// The first count of the entry, from the index of the last iteration
+	const uint32_t step = ic_palette_step(iters);
+	const uint32_t i = (n > 0 ? n - 1 : 0) / step * step;
+	float color[3];
+	if (scheme < IC_SCHEMES) {
+		ic_color(scheme, i, iters, color);
+	} else {
+		ic_palette_color(&palettes[scheme - IC_SCHEMES], i, iters, color);
+	}
+	for (int c = 0; c < 3; c++) {
+		rgb[c] = lrintf(255.0f * color[c]);
+	}
+}
+
+bool ic_load_palette(const char* path, ic_palette_t* palette) {
+	FILE* f = fopen(path, "r");
+	if (!f) return false;
+	size_t cap = 16;
+	float (*colors)[3] = malloc(cap * sizeof(*colors));
+	size_t len = 0;
+	bool ok = colors != NULL;
+	char line[256];
+	for (int num = 1; ok && fgets(line, sizeof(line), f); num++) {
+		int r, g, b;
+		if (sscanf(line, "%d %d %d", &r, &g, &b) != 3) continue;
+		if (r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255) {
+			fprintf(stderr, "%s:%d: the color is not within 0 to 255\n", path, num);
+			ok = false;
+			break;
+		}
+		if (len == cap) {
+			cap *= 2;
+			float (*grown)[3] = realloc(colors, cap * sizeof(*colors));
+			if (!grown) {
+				ok = false;
+				break;
+			}
+			colors = grown;
+		}
+		float* color = colors[len++];
+		color[0] = r / 255.0; color[1] = g / 255.0; color[2] = b / 255.0;
+	}
+	fclose(f);
+	if (!ok || len == 0) {
+		free(colors);
+		return false;
+	}
+	palette->colors = colors;
+	palette->len = len;
+	return true;
+}
+
+#endif // INTEGER_CIRCLE_IMPLEMENTATION
@@ -1,6 +1,9 @@
 #ifndef RFFT_H
 #define RFFT_H
 // Reasonably Fast Fourier Transform (in public domain)
+#include <complex.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 // Perform the FFT in place for an array of size 2^k.
 // No normalization is done.
@@ -14,6 +17,40 @@ void fft_transform_bluestein(float complex* vec, size_t n, bool inverse);
 // Perform the FFT, choosing the suitable algorithm from the two above.
 void fft_transform(float complex* vec,	size_t n, bool inverse);
 
+// A plan holds everything that depends only on the size and direction
+// of the FFT: the bit reversal permutation, the twiddle factors and for sizes
+// other than 2^k, the Bluestein chirp together with its transformed kernel.
+// Executing a plan neither allocates nor evaluates trigonometric functions.
+typedef struct fft_plan fft_plan;
+
+// Create a plan for the FFT of size n. Returns NULL if allocation fails.
+fft_plan* fft_plan_create(size_t n, bool inverse);
+
+// Perform the planned FFT in place. No normalization is done.
+void fft_plan_execute(fft_plan* plan, float complex* vec);
+
+// Perform the planned FFT of the signal re[i] + I * im[i] multiplied
+// by scale, writing the spectrum to out. The scale is applied while the
+// input is read, so passing 1/n normalizes the result without another pass.
+void fft_plan_execute_split(fft_plan* plan, const float* re, const float* im,
+			    float scale, float complex* out);
+
+// Perform the planned FFT in place on count signals of the plan size,
+// stored one after another. The signals are processed RFFT_LANES at a time
+// in an interleaved layout, so that each butterfly is a short loop across
+// the batch that the compiler vectorizes. Signals of varying lengths
+// should be bucketed by length and transformed with one plan per bucket.
+void fft_plan_execute_batch(fft_plan* plan, float complex* vecs, size_t count);
+
+void fft_plan_destroy(fft_plan* plan);
+
+// The plan API in double precision, for long signals where the float
+// rounding error drowns the weak components.
+typedef struct fft_plan_double fft_plan_double;
+fft_plan_double* fft_plan_double_create(size_t n, bool inverse);
+void fft_plan_double_execute(fft_plan_double* plan, double complex* vec);
+void fft_plan_double_destroy(fft_plan_double* plan);
+
 #endif // RFFT_H
 
 #ifdef RFFT_IMPLEMENTATION
@@ -30,6 +67,10 @@ void fft_transform(float complex* vec,	size_t n, bool inverse);
 	#define M_PI 3.14159265358979323846
 #endif 
 
+#ifndef RFFT_LANES
+	#define RFFT_LANES 8
+#endif
+
 void fft_transform_radix2(float complex* vec, size_t n, bool inverse) {
 	int levels = 0;	 // Compute levels = floor(log2(n))
 	for (size_t k =	1; (k &	n) == 0; k <<= 1)
@@ -115,4 +156,421 @@ void fft_transform(float complex* vec,	size_t n, bool inverse)	{
 		fft_transform_bluestein(vec, n,	inverse);
 }
 
+// Bit reversal permutation of the indices below m = 2^k
+static size_t* rfft_bit_reversal(size_t m) {
+	size_t* rev = RFFT_CALLOC(m, sizeof(size_t));
+	if (!rev)
+		return NULL;
+	for (size_t i = 1; i < m; i++)
+		rev[i] = (rev[i >> 1] >> 1) | ((i & 1) ? m >> 1 : 0);
+	return rev;
+}
+
+// Cooley-Tukey butterflies on bit reversed input for m = 2^k with
+// precomputed twiddle[k] = exp(-2 pi i k / m), conjugated for the inverse
+static void rfft_butterflies(float complex* vec, size_t m,
+			     const float complex* twiddle, bool inverse) {
+	for (size_t half = 1; half < m; half *= 2) {
+		size_t size = 2 * half;
+		size_t step = m / size;
+		for (size_t i = 0; i < m; i += size) {
+			for (size_t j = 0; j < half; j++) {
+				float complex omega = twiddle[j * step];
+				if (inverse)
+					omega = conjf(omega);
+				float complex tmp = vec[i + j + half] * omega;
+				vec[i + j + half] = vec[i + j] - tmp;
+				vec[i + j] += tmp;
+			}
+		}
+	}
+}
+
+// Cooley-Tukey in place for m = 2^k
+static void rfft_radix2(float complex* vec, size_t m, const size_t* rev,
+			const float complex* twiddle, bool inverse) {
+	for (size_t i = 0; i < m; i++) {
+		size_t j = rev[i];
+		if (j > i) {
+			float complex tmp = vec[i];
+			vec[i] = vec[j];
+			vec[j] = tmp;
+		}
+	}
+	rfft_butterflies(vec, m, twiddle, inverse);
+}
+
+static void rfft_radix2_double(double complex* vec, size_t m, const size_t* rev,
+			       const double complex* twiddle, bool inverse) {
+	for (size_t i = 0; i < m; i++) {
+		size_t j = rev[i];
+		if (j > i) {
+			double complex tmp = vec[i];
+			vec[i] = vec[j];
+			vec[j] = tmp;
+		}
+	}
+
+	for (size_t half = 1; half < m; half *= 2) {
+		size_t size = 2 * half;
+		size_t step = m / size;
+		for (size_t i = 0; i < m; i += size) {
+			for (size_t j = 0; j < half; j++) {
+				double complex omega = twiddle[j * step];
+				if (inverse)
+					omega = conj(omega);
+				double complex tmp = vec[i + j + half] * omega;
+				vec[i + j + half] = vec[i + j] - tmp;
+				vec[i + j] += tmp;
+			}
+		}
+	}
+}
+
+// Precomputed tables of a plan, computed in double precision for both
+// variants. For sizes other than 2^k, m is the length of the Bluestein
+// convolution, the chirp has n entries and the kernel is the transformed
+// conjugate chirp, already divided by m.
+typedef struct {
+	size_t m;
+	size_t* rev;
+	double complex* twiddle;
+	double complex* chirp;
+	double complex* kernel;
+} rfft_tables;
+
+static void rfft_tables_free(rfft_tables* t) {
+	RFFT_FREE(t->rev);
+	RFFT_FREE(t->twiddle);
+	RFFT_FREE(t->chirp);
+	RFFT_FREE(t->kernel);
+}
+
+static bool rfft_tables_init(rfft_tables* t, size_t n, bool inverse) {
+	*t = (rfft_tables){ .m = n };
+	if (n <= 1)
+		return true;
+
+	bool bluestein = (n & (n - 1)) != 0;
+	if (bluestein) {
+		// Find m = 2^k such that m >= 2 * n + 1
+		t->m = 1;
+		while (t->m <= 2 * n) {
+			t->m *= 2;
+		}
+	}
+	size_t m = t->m;
+
+	t->rev = rfft_bit_reversal(m);
+	t->twiddle = RFFT_CALLOC(m / 2, sizeof(double complex));
+	if (!t->rev || !t->twiddle)
+		goto fail;
+	for (size_t k = 0; k < m / 2; k++) {
+		double angle = -2 * M_PI * k / m;
+		t->twiddle[k] = cos(angle) + I * sin(angle);
+	}
+	if (!bluestein)
+		return true;
+
+	t->chirp = RFFT_CALLOC(n, sizeof(double complex));
+	t->kernel = RFFT_CALLOC(m, sizeof(double complex));
+	if (!t->chirp || !t->kernel)
+		goto fail;
+	for (size_t i = 0; i < n; i++) {
+		size_t k = (i * i) % (2 * n);
+		double angle = (inverse ? M_PI : -M_PI) * k / n;
+		t->chirp[i] = cos(angle) + I * sin(angle);
+	}
+	t->kernel[0] = 1.0 / m;
+	for (size_t i = 1; i < n; i++) {
+		t->kernel[i] = t->kernel[m - i] = conj(t->chirp[i]) / m;
+	}
+	rfft_radix2_double(t->kernel, m, t->rev, t->twiddle, false);
+	return true;
+
+fail:
+	rfft_tables_free(t);
+	return false;
+}
+
+struct fft_plan {
+	size_t n;
+	size_t m;
+	bool inverse;
+	size_t* rev;
+	float complex* twiddle;
+	float complex* chirp;
+	float complex* kernel;
+	float complex* work;
+	float* lanes; // real and imaginary parts of the batch, RFFT_LANES wide
+};
+
+fft_plan* fft_plan_create(size_t n, bool inverse) {
+	rfft_tables t;
+	if (!rfft_tables_init(&t, n, inverse))
+		return NULL;
+
+	fft_plan* plan = RFFT_CALLOC(1, sizeof(fft_plan));
+	if (!plan)
+		goto fail;
+	*plan = (fft_plan){ .n = n, .m = t.m, .inverse = inverse, .rev = t.rev };
+	t.rev = NULL;
+	if (n <= 1)
+		goto done;
+
+	size_t m = t.m;
+	plan->twiddle = RFFT_CALLOC(m / 2, sizeof(float complex));
+	if (!plan->twiddle)
+		goto fail;
+	for (size_t k = 0; k < m / 2; k++)
+		plan->twiddle[k] = t.twiddle[k];
+	if (!t.chirp)
+		goto done;
+
+	plan->chirp = RFFT_CALLOC(n, sizeof(float complex));
+	plan->kernel = RFFT_CALLOC(m, sizeof(float complex));
+	plan->work = RFFT_CALLOC(m, sizeof(float complex));
+	if (!plan->chirp || !plan->kernel || !plan->work)
+		goto fail;
+	for (size_t i = 0; i < n; i++)
+		plan->chirp[i] = t.chirp[i];
+	for (size_t i = 0; i < m; i++)
+		plan->kernel[i] = t.kernel[i];
+
+done:
+	rfft_tables_free(&t);
+	return plan;
+
+fail:
+	rfft_tables_free(&t);
+	fft_plan_destroy(plan);
+	return NULL;
+}
+
+void fft_plan_execute(fft_plan* plan, float complex* vec) {
+	size_t n = plan->n, m = plan->m;
+	if (n <= 1)
+		return;
+	if (!plan->chirp) {
+		rfft_radix2(vec, n, plan->rev, plan->twiddle, plan->inverse);
+		return;
+	}
+
+	float complex* work = plan->work;
+	for (size_t i = 0; i < n; i++)
+		work[i] = vec[i] * plan->chirp[i];
+	for (size_t i = n; i < m; i++)
+		work[i] = 0;
+	rfft_radix2(work, m, plan->rev, plan->twiddle, false);
+	for (size_t i = 0; i < m; i++)
+		work[i] *= plan->kernel[i];
+	rfft_radix2(work, m, plan->rev, plan->twiddle, true);
+	for (size_t i = 0; i < n; i++)
+		vec[i] = work[i] * plan->chirp[i];
+}
+
+void fft_plan_execute_split(fft_plan* plan, const float* re, const float* im,
+			    float scale, float complex* out) {
+	size_t n = plan->n, m = plan->m;
+	if (n == 0)
+		return;
+	if (n == 1) {
+		out[0] = scale * (re[0] + I * im[0]);
+		return;
+	}
+	if (!plan->chirp) {
+		for (size_t i = 0; i < n; i++) {
+			size_t j = plan->rev[i];
+			out[i] = scale * (re[j] + I * im[j]);
+		}
+		rfft_butterflies(out, n, plan->twiddle, plan->inverse);
+		return;
+	}
+
+	float complex* work = plan->work;
+	for (size_t i = 0; i < n; i++)
+		work[i] = scale * (re[i] + I * im[i]) * plan->chirp[i];
+	for (size_t i = n; i < m; i++)
+		work[i] = 0;
+	rfft_radix2(work, m, plan->rev, plan->twiddle, false);
+	for (size_t i = 0; i < m; i++)
+		work[i] *= plan->kernel[i];
+	rfft_radix2(work, m, plan->rev, plan->twiddle, true);
+	for (size_t i = 0; i < n; i++)
+		out[i] = work[i] * plan->chirp[i];
+}
+
+void fft_plan_destroy(fft_plan* plan) {
+	if (!plan)
+		return;
+	RFFT_FREE(plan->rev);
+	RFFT_FREE(plan->twiddle);
+	RFFT_FREE(plan->chirp);
+	RFFT_FREE(plan->kernel);
+	RFFT_FREE(plan->work);
+	RFFT_FREE(plan->lanes);
+	RFFT_FREE(plan);
+}
+
+// Cooley-Tukey butterflies on bit reversed rows of RFFT_LANES signals
+static void rfft_radix2_lanes(float* re, float* im, size_t m,
+			      const float complex* twiddle, bool inverse) {
+	const size_t L = RFFT_LANES;
+	for (size_t half = 1; half < m; half *= 2) {
+		size_t size = 2 * half;
+		size_t step = m / size;
+		for (size_t i = 0; i < m; i += size) {
+			for (size_t j = 0; j < half; j++) {
+				float wr = crealf(twiddle[j * step]);
+				float wi = inverse ? -cimagf(twiddle[j * step])
+						   : cimagf(twiddle[j * step]);
+				float* ar = re + (i + j) * L;
+				float* ai = im + (i + j) * L;
+				float* br = re + (i + j + half) * L;
+				float* bi = im + (i + j + half) * L;
+				for (size_t l = 0; l < L; l++) {
+					float tr = br[l] * wr - bi[l] * wi;
+					float ti = br[l] * wi + bi[l] * wr;
+					br[l] = ar[l] - tr;
+					bi[l] = ai[l] - ti;
+					ar[l] += tr;
+					ai[l] += ti;
+				}
+			}
+		}
+	}
+}
+
+void fft_plan_execute_batch(fft_plan* plan, float complex* vecs, size_t count) {
+	const size_t L = RFFT_LANES;
+	size_t n = plan->n, m = plan->m;
+	if (n <= 1)
+		return;
+	if (!plan->lanes)
+		plan->lanes = RFFT_CALLOC(2 * m * L, sizeof(float));
+	if (!plan->lanes) {
+		for (size_t b = 0; b < count; b++)
+			fft_plan_execute(plan, vecs + b * n);
+		return;
+	}
+
+	float* re = plan->lanes;
+	float* im = plan->lanes + m * L;
+	for (size_t b0 = 0; b0 < count; b0 += L) {
+		size_t lanes = count - b0 < L ? count - b0 : L;
+		float complex* vec = vecs + b0 * n;
+
+		// Load the signals in bit reversed order
+		if (plan->chirp || lanes < L) {
+			for (size_t i = 0; i < 2 * m * L; i++)
+				re[i] = 0;
+		}
+		for (size_t l = 0; l < lanes; l++) {
+			for (size_t i = 0; i < n; i++) {
+				float complex v = vec[l * n + i];
+				if (plan->chirp)
+					v *= plan->chirp[i];
+				re[plan->rev[i] * L + l] = crealf(v);
+				im[plan->rev[i] * L + l] = cimagf(v);
+			}
+		}
+
+		if (plan->chirp) {
+			// Convolution with the chirp
+			rfft_radix2_lanes(re, im, m, plan->twiddle, false);
+			for (size_t i = 0; i < m; i++) {
+				float kr = crealf(plan->kernel[i]);
+				float ki = cimagf(plan->kernel[i]);
+				for (size_t l = 0; l < L; l++) {
+					float r = re[i * L + l], j = im[i * L + l];
+					re[i * L + l] = r * kr - j * ki;
+					im[i * L + l] = r * ki + j * kr;
+				}
+			}
+			for (size_t i = 0; i < m; i++) {
+				size_t j = plan->rev[i];
+				if (j <= i)
+					continue;
+				for (size_t l = 0; l < L; l++) {
+					float tr = re[i * L + l], ti = im[i * L + l];
+					re[i * L + l] = re[j * L + l];
+					im[i * L + l] = im[j * L + l];
+					re[j * L + l] = tr;
+					im[j * L + l] = ti;
+				}
+			}
+			rfft_radix2_lanes(re, im, m, plan->twiddle, true);
+		} else {
+			rfft_radix2_lanes(re, im, m, plan->twiddle, plan->inverse);
+		}
+
+		for (size_t l = 0; l < lanes; l++) {
+			for (size_t i = 0; i < n; i++) {
+				float complex v = re[i * L + l] + I * im[i * L + l];
+				if (plan->chirp)
+					v *= plan->chirp[i];
+				vec[l * n + i] = v;
+			}
+		}
+	}
+}
+
+struct fft_plan_double {
+	size_t n;
+	bool inverse;
+	rfft_tables t;
+	double complex* work;
+};
+
+fft_plan_double* fft_plan_double_create(size_t n, bool inverse) {
+	fft_plan_double* plan = RFFT_CALLOC(1, sizeof(fft_plan_double));
+	if (!plan)
+		return NULL;
+	plan->n = n;
+	plan->inverse = inverse;
+	if (!rfft_tables_init(&plan->t, n, inverse)) {
+		RFFT_FREE(plan);
+		return NULL;
+	}
+	if (plan->t.chirp) {
+		plan->work = RFFT_CALLOC(plan->t.m, sizeof(double complex));
+		if (!plan->work) {
+			fft_plan_double_destroy(plan);
+			return NULL;
+		}
+	}
+	return plan;
+}
+
+void fft_plan_double_execute(fft_plan_double* plan, double complex* vec) {
+	const rfft_tables* t = &plan->t;
+	size_t n = plan->n, m = t->m;
+	if (n <= 1)
+		return;
+	if (!t->chirp) {
+		rfft_radix2_double(vec, n, t->rev, t->twiddle, plan->inverse);
+		return;
+	}
+
+	double complex* work = plan->work;
+	for (size_t i = 0; i < n; i++)
+		work[i] = vec[i] * t->chirp[i];
+	for (size_t i = n; i < m; i++)
+		work[i] = 0;
+	rfft_radix2_double(work, m, t->rev, t->twiddle, false);
+	for (size_t i = 0; i < m; i++)
+		work[i] *= t->kernel[i];
+	rfft_radix2_double(work, m, t->rev, t->twiddle, true);
+	for (size_t i = 0; i < n; i++)
+		vec[i] = work[i] * t->chirp[i];
+}
+
+void fft_plan_double_destroy(fft_plan_double* plan) {
+	if (!plan)
+		return;
+	rfft_tables_free(&plan->t);
+	RFFT_FREE(plan->work);
+	RFFT_FREE(plan);
+}
+
 #endif // RFFT_IMPLEMENTATION
@@ -11,6 +11,5 @@
 #include "sokol_audio.h"
 #include "sokol_glue.h"
 #include "sokol_log.h"
-#define RFFT_H
 #define RFFT_IMPLEMENTATION
 #include "rfft.h"